@@ -0,0 +1,763 @@
+/*
+ * 基于 muduo 的 HTTP 压测工具
+ *
+ * 两种压测模式：
+ *      闭环(closed-loop)：每个连接保持 pipeline 个在途请求，收到一个响应就立刻再发一个，测的是最大吞吐
+ *      开环(open-loop)：  按照 --rate 指定的固定速率发请求，不管服务器有没有回复，测的是给定负载下的延迟
+ *                          延迟从"计划发送时间"开始算，服务器卡住的时候排队的时间也会被算进去(避免 coordinated omission)
+ *
+ * 延迟记录在 metrics::LatencyHistogram (HDR 风格的直方图) 里面，每个线程一份，结束的时候再合并，
+ * 可以用 --hdr-out 输出 HdrHistogram 的 .hgrm 格式，方便和以前的结果画在一起对比
+ *
+ * 用法见 benchmark/run_benchmark.sh
+*/
+
+#include "../include/metrics/Metrics.h"
+
+#include <getopt.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <muduo/base/CountDownLatch.h>
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThread.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpClient.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+using muduo::net::Buffer;
+using muduo::net::EventLoop;
+using muduo::net::InetAddress;
+using muduo::net::TcpClient;
+using muduo::net::TcpConnectionPtr;
+using http::metrics::LatencyHistogram;
+using http::metrics::nowMicros;
+
+namespace bench
+{
+
+struct Options
+{
+    std::string                 host = "127.0.0.1";
+    uint16_t                    port = 8080;
+    int                         threads = 2;            // IO 线程数
+    int                         connections = 32;       // 总连接数，平均分到每个线程上
+    double                      duration = 10;          // 压测时长(秒)
+    double                      warmup = 0;             // 预热时长(秒)，这段时间内的结果不统计
+    double                      rate = 0;               // 开环模式下的总请求速率(req/s)，0 表示闭环模式
+    int                         pipeline = 1;           // 闭环模式下每个连接的在途请求数
+    bool                        keepAlive = true;
+    bool                        tls = false;
+    std::string                 method = "GET";
+    std::string                 path = "/";
+    std::string                 body;
+    std::vector<std::string>    headers;
+    std::string                 hdrOut;                 // .hgrm 输出文件
+};
+
+// 每个线程一份，只有所属的 loop 线程会写
+struct WorkerStats
+{
+    LatencyHistogram    latency;
+    uint64_t            responses = 0;
+    uint64_t            status[6] = { 0 };      // 按 1xx ~ 5xx 统计，status[0] 是无法识别的状态码
+    uint64_t            bytesIn = 0;
+    uint64_t            connects = 0;
+    uint64_t            connectionErrors = 0;   // 连接在还有在途请求的时候断开
+    uint64_t            parseErrors = 0;
+};
+
+// 一个客户端连接，负责发请求、解析响应、记录延迟
+class Connection : muduo::noncopyable
+{
+public:
+    Connection(EventLoop* loop, const InetAddress& addr, const Options& options,
+               const std::string& request, SSL_CTX* sslCtx, WorkerStats* stats,
+               uint64_t startMicros, uint64_t measureFrom, int id)
+        : loop_(loop)
+        , addr_(addr)
+        , options_(options)
+        , request_(request)
+        , sslCtx_(sslCtx)
+        , ssl_(nullptr)
+        , stats_(stats)
+        , startMicros_(startMicros)
+        , measureFrom_(measureFrom)
+        , id_(id)
+        , scheduled_(0)
+        , sentOnConnection_(0)
+        , stopping_(false)
+    {
+        if(options_.rate > 0)
+        {
+            // 总速率平均分给每个连接
+            intervalMicros_ = 1e6 * options_.connections / options_.rate;
+        }
+    }
+
+    ~Connection()
+    {
+        freeSsl();
+    }
+
+    void start()
+    {
+        client_ = std::make_unique<TcpClient>(loop_, addr_, "bench-" + std::to_string(id_));
+        client_->setConnectionCallback(std::bind(&Connection::onConnection, this, std::placeholders::_1));
+        client_->setMessageCallback(std::bind(&Connection::onMessage, this,
+                                    std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        client_->connect();
+    }
+
+    void stop()
+    {
+        stopping_ = true;
+        if(conn_)
+        {
+            // TcpClient 析构之后连接才真正关闭，那时候不能再回调到这里
+            conn_->setConnectionCallback([](const TcpConnectionPtr&) {});
+            conn_->setMessageCallback([](const TcpConnectionPtr&, Buffer* buf, muduo::Timestamp) { buf->retrieveAll(); });
+            conn_.reset();
+        }
+        client_.reset();
+    }
+
+    // 开环模式下由 Worker 的定时器驱动，把已经到点的请求放进待发送队列
+    void onTick(uint64_t now)
+    {
+        if(intervalMicros_ <= 0)
+        {
+            return;
+        }
+
+        // 第一个请求按连接 id 错开，避免所有连接同时发
+        double offset = intervalMicros_ * id_ / options_.connections;
+        while(startMicros_ + offset + scheduled_ * intervalMicros_ <= now)
+        {
+            pending_.push_back(startMicros_ + static_cast<uint64_t>(offset + scheduled_ * intervalMicros_));
+            ++scheduled_;
+        }
+        trySend();
+    }
+
+private:
+    bool ready() const
+    {
+        return conn_ && conn_->connected() && (!ssl_ || SSL_is_init_finished(ssl_));
+    }
+
+    void onConnection(const TcpConnectionPtr& conn)
+    {
+        if(conn->connected())
+        {
+            conn_ = conn;
+            conn_->setTcpNoDelay(true);
+            ++stats_->connects;
+            sentOnConnection_ = 0;
+            buffered_ = 0;
+            plain_.retrieveAll();
+
+            if(sslCtx_)
+            {
+                ssl_ = SSL_new(sslCtx_);
+                SSL_set_bio(ssl_, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+                SSL_set_connect_state(ssl_);
+                SSL_do_handshake(ssl_);
+                flushTls();
+            }
+            else
+            {
+                trySend();
+            }
+        }
+        else
+        {
+            conn_.reset();
+            freeSsl();
+
+            // 连接断开的时候还没收到响应的请求都算作错误
+            stats_->connectionErrors += inflight_.size();
+
+            // 开环模式下没有收到响应的请求重新排队，计划时间不变
+            if(intervalMicros_ > 0)
+            {
+                pending_.insert(pending_.begin(), inflight_.begin(), inflight_.end());
+            }
+            inflight_.clear();
+
+            if(!stopping_)
+            {
+                // 不能在 TcpClient 自己的回调里面析构它，放到下一轮再重连
+                loop_->queueInLoop([this] {
+                    if(!stopping_)
+                    {
+                        start();
+                    }
+                });
+            }
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr& /* conn */, Buffer* buf, muduo::Timestamp /* receiveTime */)
+    {
+        if(!ssl_)
+        {
+            // 上次没解析完的数据还留在 buf 里面，不能重复统计
+            stats_->bytesIn += buf->readableBytes() - buffered_;
+            parseResponses(buf);
+            buffered_ = buf->readableBytes();
+            return;
+        }
+
+        stats_->bytesIn += buf->readableBytes();
+        BIO_write(SSL_get_rbio(ssl_), buf->peek(), static_cast<int>(buf->readableBytes()));
+        buf->retrieveAll();
+
+        if(!SSL_is_init_finished(ssl_))
+        {
+            int ret = SSL_do_handshake(ssl_);
+            flushTls();
+            if(ret == 1)
+            {
+                trySend();
+            }
+            else if(SSL_get_error(ssl_, ret) != SSL_ERROR_WANT_READ)
+            {
+                LOG_ERROR << "TLS handshake failed: " << ERR_error_string(ERR_get_error(), nullptr);
+                conn_->forceClose();
+                return;
+            }
+        }
+
+        char data[16384];
+        int n;
+        while((n = SSL_read(ssl_, data, sizeof data)) > 0)
+        {
+            plain_.append(data, n);
+        }
+        flushTls();
+        parseResponses(&plain_);
+    }
+
+    // 解析缓冲区中所有完整的响应
+    void parseResponses(Buffer* buf)
+    {
+        while(true)
+        {
+            const char* begin = buf->peek();
+            const char* end = begin + buf->readableBytes();
+            const char kHeaderEnd[] = "\r\n\r\n";
+            const char* headerEnd = std::search(begin, end, kHeaderEnd, kHeaderEnd + 4);
+            if(headerEnd == end)
+            {
+                return;
+            }
+
+            // HTTP/1.1 200 OK
+            int code = 0;
+            if(end - begin < 12 || sscanf(begin + 9, "%3d", &code) != 1)
+            {
+                ++stats_->parseErrors;
+                conn_->forceClose();
+                return;
+            }
+
+            size_t contentLength = 0;
+            const char* line = std::find(begin, headerEnd, '\n') + 1;
+            while(line < headerEnd)
+            {
+                const char* lineEnd = std::find(line, headerEnd, '\r');
+                if(lineEnd - line > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+                {
+                    contentLength = strtoul(line + 15, nullptr, 10);
+                }
+                line = lineEnd + 2;
+            }
+
+            size_t total = (headerEnd + 4 - begin) + contentLength;
+            if(buf->readableBytes() < total)
+            {
+                return;
+            }
+            buf->retrieve(total);
+            onResponse(code);
+        }
+    }
+
+    void onResponse(int code)
+    {
+        if(inflight_.empty())
+        {
+            ++stats_->parseErrors;
+            return;
+        }
+
+        uint64_t sentAt = inflight_.front();
+        inflight_.pop_front();
+        if(sentAt >= measureFrom_)
+        {
+            stats_->latency.record(nowMicros() - sentAt);
+            ++stats_->responses;
+            ++stats_->status[code >= 100 && code < 600 ? code / 100 : 0];
+        }
+
+        trySend();
+    }
+
+    void trySend()
+    {
+        while(!stopping_ && ready())
+        {
+            // 短连接模式下每个连接只发一个请求
+            if(!options_.keepAlive && sentOnConnection_ > 0)
+            {
+                return;
+            }
+
+            uint64_t sentAt;
+            if(intervalMicros_ > 0)
+            {
+                if(pending_.empty())
+                {
+                    return;
+                }
+                sentAt = pending_.front();
+                pending_.pop_front();
+            }
+            else
+            {
+                if(static_cast<int>(inflight_.size()) >= options_.pipeline)
+                {
+                    return;
+                }
+                sentAt = nowMicros();
+            }
+
+            inflight_.push_back(sentAt);
+            ++sentOnConnection_;
+            write(request_.data(), request_.size());
+        }
+    }
+
+    void write(const char* data, size_t len)
+    {
+        if(ssl_)
+        {
+            SSL_write(ssl_, data, static_cast<int>(len));
+            flushTls();
+        }
+        else
+        {
+            conn_->send(data, static_cast<int>(len));
+        }
+    }
+
+    // 把 OpenSSL 写到 BIO 里面的密文发出去
+    void flushTls()
+    {
+        if(!ssl_ || !conn_)
+        {
+            return;
+        }
+
+        BIO* wbio = SSL_get_wbio(ssl_);
+        char data[16384];
+        int n;
+        while((n = BIO_read(wbio, data, sizeof data)) > 0)
+        {
+            conn_->send(data, n);
+        }
+    }
+
+    void freeSsl()
+    {
+        if(ssl_)
+        {
+            SSL_free(ssl_);
+            ssl_ = nullptr;
+        }
+    }
+
+private:
+    EventLoop*                  loop_;
+    InetAddress                 addr_;
+    const Options&              options_;
+    const std::string&          request_;
+    SSL_CTX*                    sslCtx_;
+    SSL*                        ssl_;
+    WorkerStats*                stats_;
+    uint64_t                    startMicros_;
+    uint64_t                    measureFrom_;       // 计划发送时间早于这个值的请求属于预热
+    int                         id_;
+    double                      intervalMicros_ = 0;
+    uint64_t                    scheduled_;         // 开环模式下已经排进队列的请求数
+    int                         sentOnConnection_;
+    size_t                      buffered_ = 0;      // 明文模式下上次留在 buf 里面的字节数
+    bool                        stopping_;
+    std::unique_ptr<TcpClient>  client_;
+    TcpConnectionPtr            conn_;
+    Buffer                      plain_;             // TLS 解密后的数据
+    std::deque<uint64_t>        pending_;           // 开环模式下到点但还没发出去的请求
+    std::deque<uint64_t>        inflight_;          // 已发出、等待响应的请求
+};
+
+// 一个 IO 线程以及它上面的所有连接
+class Worker : muduo::noncopyable
+{
+public:
+    Worker(const Options& options, const std::string& request, SSL_CTX* sslCtx, int firstId, int numConnections)
+        : options_(options)
+        , request_(request)
+        , sslCtx_(sslCtx)
+        , firstId_(firstId)
+        , numConnections_(numConnections)
+        , loop_(thread_.startLoop())
+    {}
+
+    void start(uint64_t startMicros, uint64_t measureFrom)
+    {
+        loop_->runInLoop([this, startMicros, measureFrom] {
+            InetAddress addr(options_.host, options_.port);
+            for(int i = 0; i < numConnections_; ++i)
+            {
+                connections_.push_back(std::make_unique<Connection>(loop_, addr, options_, request_, sslCtx_,
+                                        &stats_, startMicros, measureFrom, firstId_ + i));
+                connections_.back()->start();
+            }
+
+            if(options_.rate > 0)
+            {
+                loop_->runEvery(0.001, [this] {
+                    uint64_t now = nowMicros();
+                    for(auto& conn : connections_)
+                    {
+                        conn->onTick(now);
+                    }
+                });
+            }
+        });
+    }
+
+    // 在 loop 线程里面关掉所有连接，返回之后 stats_ 就可以在主线程读了
+    // Connection 对象本身留到 loop 线程退出之后再析构，避免还有排队的回调用到它们
+    void stop()
+    {
+        muduo::CountDownLatch latch(1);
+        loop_->runInLoop([this, &latch] {
+            for(auto& conn : connections_)
+            {
+                conn->stop();
+            }
+            latch.countDown();
+        });
+        latch.wait();
+    }
+
+    const WorkerStats& stats() const
+    { return stats_; }
+
+private:
+    const Options&                              options_;
+    const std::string&                          request_;
+    SSL_CTX*                                    sslCtx_;
+    int                                         firstId_;
+    int                                         numConnections_;
+    WorkerStats                                 stats_;
+    std::vector<std::unique_ptr<Connection>>    connections_;
+    muduo::net::EventLoopThread                 thread_;            // 最先析构，先停掉 loop 线程
+    EventLoop*                                  loop_;
+};
+
+std::string buildRequest(const Options& options)
+{
+    std::string req = options.method + " " + options.path + " HTTP/1.1\r\n";
+    req += "Host: " + options.host + ":" + std::to_string(options.port) + "\r\n";
+    req += options.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    for(const auto& header : options.headers)
+    {
+        req += header + "\r\n";
+    }
+    if(!options.body.empty() || options.method == "POST" || options.method == "PUT")
+    {
+        req += "Content-Length: " + std::to_string(options.body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    req += options.body;
+    return req;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& buckets, uint64_t count, double p)
+{
+    uint64_t target = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if(seen >= target && seen > 0)
+        {
+            return LatencyHistogram::bucketUpperBound(i);
+        }
+    }
+    return 0;
+}
+
+// HdrHistogram 的 percentile distribution 格式，值的单位是毫秒
+void writeHgrm(const std::string& file, const std::vector<uint64_t>& buckets, uint64_t count, uint64_t sum)
+{
+    std::ofstream out(file);
+    if(!out)
+    {
+        LOG_ERROR << "Cannot open " << file;
+        return;
+    }
+
+    char line[128];
+    out << "       Value     Percentile TotalCount 1/(1-Percentile)\n\n";
+    uint64_t seen = 0;
+    uint64_t max = 0;
+    double sumSquares = 0;
+    double mean = count ? static_cast<double>(sum) / count : 0;
+    for(size_t i = 0; i < buckets.size(); ++i)
+    {
+        if(buckets[i] == 0)
+        {
+            continue;
+        }
+        seen += buckets[i];
+        max = LatencyHistogram::bucketUpperBound(i);
+        double diff = max - mean;
+        sumSquares += diff * diff * buckets[i];
+
+        double p = static_cast<double>(seen) / count;
+        if(p < 1.0)
+        {
+            snprintf(line, sizeof line, "%12.3f %14.12f %10llu %14.2f\n",
+                     max / 1000.0, p, static_cast<unsigned long long>(seen), 1.0 / (1.0 - p));
+        }
+        else
+        {
+            snprintf(line, sizeof line, "%12.3f %14.12f %10llu\n",
+                     max / 1000.0, p, static_cast<unsigned long long>(seen));
+        }
+        out << line;
+    }
+
+    snprintf(line, sizeof line, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+             mean / 1000.0, count ? std::sqrt(sumSquares / count) / 1000.0 : 0.0);
+    out << line;
+    snprintf(line, sizeof line, "#[Max     = %12.3f, Total count    = %12llu]\n",
+             max / 1000.0, static_cast<unsigned long long>(count));
+    out << line;
+    snprintf(line, sizeof line, "#[Buckets = %12zu, SubBuckets     = %12d]\n",
+             LatencyHistogram::kBucketCount, 1 << LatencyHistogram::kSubBucketBits);
+    out << line;
+}
+
+void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [host[:port]]\n"
+        "  -t, --threads N        IO threads (default 2)\n"
+        "  -c, --connections N    total connections (default 32)\n"
+        "  -d, --duration SEC     test duration (default 10)\n"
+        "  -w, --warmup SEC       warmup before recording (default 0)\n"
+        "  -r, --rate N           open-loop: total requests/sec; omit for closed-loop\n"
+        "  -p, --pipeline N       closed-loop: in-flight requests per connection (default 1)\n"
+        "  -k, --no-keepalive     one request per connection\n"
+        "  -s, --tls              use TLS\n"
+        "  -m, --method M         request method (default GET)\n"
+        "  -u, --path P           request path (default /)\n"
+        "  -b, --body S           request body\n"
+        "  -H, --header 'K: V'    extra request header, may repeat\n"
+        "  -o, --hdr-out FILE     write HdrHistogram percentile distribution\n",
+        prog);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    static const struct option longOptions[] = {
+        { "threads",      required_argument, nullptr, 't' },
+        { "connections",  required_argument, nullptr, 'c' },
+        { "duration",     required_argument, nullptr, 'd' },
+        { "warmup",       required_argument, nullptr, 'w' },
+        { "rate",         required_argument, nullptr, 'r' },
+        { "pipeline",     required_argument, nullptr, 'p' },
+        { "no-keepalive", no_argument,       nullptr, 'k' },
+        { "tls",          no_argument,       nullptr, 's' },
+        { "method",       required_argument, nullptr, 'm' },
+        { "path",         required_argument, nullptr, 'u' },
+        { "body",         required_argument, nullptr, 'b' },
+        { "header",       required_argument, nullptr, 'H' },
+        { "hdr-out",      required_argument, nullptr, 'o' },
+        { "help",         no_argument,       nullptr, 'h' },
+        { nullptr,        0,                 nullptr, 0   },
+    };
+
+    int opt;
+    while((opt = getopt_long(argc, argv, "t:c:d:w:r:p:ksm:u:b:H:o:h", longOptions, nullptr)) != -1)
+    {
+        switch(opt)
+        {
+            case 't': options.threads = atoi(optarg); break;
+            case 'c': options.connections = atoi(optarg); break;
+            case 'd': options.duration = atof(optarg); break;
+            case 'w': options.warmup = atof(optarg); break;
+            case 'r': options.rate = atof(optarg); break;
+            case 'p': options.pipeline = atoi(optarg); break;
+            case 'k': options.keepAlive = false; break;
+            case 's': options.tls = true; break;
+            case 'm': options.method = optarg; break;
+            case 'u': options.path = optarg; break;
+            case 'b': options.body = optarg; break;
+            case 'H': options.headers.push_back(optarg); break;
+            case 'o': options.hdrOut = optarg; break;
+            default: return false;
+        }
+    }
+
+    if(optind < argc)
+    {
+        std::string target = argv[optind];
+        std::string::size_type colon = target.find(':');
+        options.host = target.substr(0, colon);
+        if(colon != std::string::npos)
+        {
+            options.port = static_cast<uint16_t>(atoi(target.c_str() + colon + 1));
+        }
+    }
+
+    if(options.threads <= 0 || options.connections < options.threads || options.duration <= 0 || options.pipeline <= 0)
+    {
+        fprintf(stderr, "invalid options: need threads > 0, connections >= threads, duration > 0, pipeline > 0\n");
+        return false;
+    }
+    if(!options.keepAlive && options.pipeline > 1)
+    {
+        fprintf(stderr, "--pipeline requires keep-alive\n");
+        return false;
+    }
+    return true;
+}
+
+} // namespace bench
+
+int main(int argc, char* argv[])
+{
+    bench::Options options;
+    if(!bench::parseOptions(argc, argv, options))
+    {
+        bench::usage(argv[0]);
+        return 1;
+    }
+
+    muduo::Logger::setLogLevel(muduo::Logger::WARN);
+
+    SSL_CTX* sslCtx = nullptr;
+    if(options.tls)
+    {
+        OPENSSL_init_ssl(0, nullptr);
+        sslCtx = SSL_CTX_new(TLS_client_method());
+        // 压测对象一般是自签名证书，这里不校验
+        SSL_CTX_set_verify(sslCtx, SSL_VERIFY_NONE, nullptr);
+    }
+
+    std::string request = bench::buildRequest(options);
+
+    std::vector<std::unique_ptr<bench::Worker>> workers;
+    int assigned = 0;
+    for(int i = 0; i < options.threads; ++i)
+    {
+        int n = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+        workers.push_back(std::make_unique<bench::Worker>(options, request, sslCtx, assigned, n));
+        assigned += n;
+    }
+
+    uint64_t start = nowMicros();
+    uint64_t measureFrom = start + static_cast<uint64_t>(options.warmup * 1e6);
+    for(auto& worker : workers)
+    {
+        worker->start(start, measureFrom);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(static_cast<uint64_t>((options.warmup + options.duration) * 1e6)));
+    for(auto& worker : workers)
+    {
+        worker->stop();
+    }
+    double elapsed = (nowMicros() - measureFrom) / 1e6;
+
+    // 合并各个线程的统计
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    bench::WorkerStats total;
+    for(auto& worker : workers)
+    {
+        const bench::WorkerStats& s = worker->stats();
+        s.latency.mergeInto(buckets, count, sum);
+        total.responses += s.responses;
+        total.bytesIn += s.bytesIn;
+        total.connects += s.connects;
+        total.connectionErrors += s.connectionErrors;
+        total.parseErrors += s.parseErrors;
+        for(int i = 0; i < 6; ++i)
+        {
+            total.status[i] += s.status[i];
+        }
+    }
+
+    printf("%s %s:%u%s  %s  threads=%d connections=%d %s%s%s\n",
+           options.method.c_str(), options.host.c_str(), options.port, options.path.c_str(),
+           options.rate > 0 ? "open-loop" : "closed-loop", options.threads, options.connections,
+           options.keepAlive ? "keep-alive" : "close",
+           options.tls ? " tls" : "",
+           options.rate > 0 ? (" rate=" + std::to_string(static_cast<long>(options.rate))).c_str()
+                            : (" pipeline=" + std::to_string(options.pipeline)).c_str());
+    printf("  %.2fs, %llu responses, %.1f req/s, %.2f MB/s in, %llu connects\n",
+           elapsed, static_cast<unsigned long long>(total.responses), total.responses / elapsed,
+           total.bytesIn / elapsed / 1e6, static_cast<unsigned long long>(total.connects));
+    printf("  status: 2xx=%llu 3xx=%llu 4xx=%llu 5xx=%llu other=%llu  errors: connection=%llu parse=%llu\n",
+           static_cast<unsigned long long>(total.status[2]), static_cast<unsigned long long>(total.status[3]),
+           static_cast<unsigned long long>(total.status[4]), static_cast<unsigned long long>(total.status[5]),
+           static_cast<unsigned long long>(total.status[0] + total.status[1]),
+           static_cast<unsigned long long>(total.connectionErrors), static_cast<unsigned long long>(total.parseErrors));
+    printf("  latency(us): mean=%.1f p50=%llu p90=%llu p99=%llu p99.9=%llu p99.99=%llu max=%llu\n",
+           count ? static_cast<double>(sum) / count : 0.0,
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 50)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 90)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 99)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 99.9)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 99.99)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 100)));
+    // 给脚本用的单行结果，方便和基线比较
+    printf("RESULT rps=%.1f p50_us=%llu p99_us=%llu errors=%llu\n",
+           total.responses / elapsed,
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 50)),
+           static_cast<unsigned long long>(bench::percentile(buckets, count, 99)),
+           static_cast<unsigned long long>(total.connectionErrors + total.parseErrors + total.status[4] + total.status[5]));
+
+    if(!options.hdrOut.empty())
+    {
+        bench::writeHgrm(options.hdrOut, buckets, count, sum);
+    }
+
+    workers.clear();
+    if(sslCtx)
+    {
+        SSL_CTX_free(sslCtx);
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+#!/bin/bash
+
+# 编译 testServer 和压测工具 loadgen，跑一组固定的压测场景
+#
+# 用法:
+#   ./benchmark/run_benchmark.sh                       # 跑全部场景，结果写到 bench_results/<时间>/
+#   ./benchmark/run_benchmark.sh plain-get tls-get     # 只跑指定的场景
+#   BASELINE=bench_results/20261018-120000 ./benchmark/run_benchmark.sh
+#                                                      # 和以前的结果对比，吞吐或 p99 退化超过阈值时返回非 0
+#
+# 可调的环境变量:
+#   DURATION          每个场景的压测时长(秒)，默认 10
+#   WARMUP            预热时长(秒)，默认 2
+#   SERVER_THREADS    testServer 的 IO 线程数，默认 2
+#   CLIENT_THREADS    loadgen 的线程数，默认 2
+#   CONNECTIONS       连接数，默认 64
+#   RATE              开环场景的请求速率(req/s)，默认 20000
+#   SERVER_CPUS       testServer 绑定的 CPU，默认前一半的核
+#   CLIENT_CPUS       loadgen 绑定的 CPU，默认后一半的核
+#   RPS_THRESHOLD     吞吐下降超过多少百分比算退化，默认 5
+#   P99_THRESHOLD     p99 上升超过多少百分比算退化，默认 10
+#
+# 为了在同一台机器上得到可重复的结果，服务端和客户端绑定在不相交的核上，
+# 并且服务端用 --quiet 关掉每个请求的 INFO 日志
+
+set -e
+
+PROJECT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+cd "$PROJECT_DIR"
+
+DURATION=${DURATION:-10}
+WARMUP=${WARMUP:-2}
+SERVER_THREADS=${SERVER_THREADS:-2}
+CLIENT_THREADS=${CLIENT_THREADS:-2}
+CONNECTIONS=${CONNECTIONS:-64}
+RATE=${RATE:-20000}
+RPS_THRESHOLD=${RPS_THRESHOLD:-5}
+P99_THRESHOLD=${P99_THRESHOLD:-10}
+
+NCPU=$(nproc)
+HALF=$(( NCPU / 2 > 0 ? NCPU / 2 : 1 ))
+SERVER_CPUS=${SERVER_CPUS:-0-$(( HALF - 1 ))}
+CLIENT_CPUS=${CLIENT_CPUS:-$(( HALF < NCPU ? HALF : 0 ))-$(( NCPU - 1 ))}
+
+BUILD_DIR="$PROJECT_DIR/bench_build"
+RESULT_DIR="$PROJECT_DIR/bench_results/$(date +%Y%m%d-%H%M%S)"
+mkdir -p "$BUILD_DIR" "$RESULT_DIR"
+
+SERVER_SOURCES="
+    src/http/HttpServer.cc
+    src/http/HttpRequest.cc
+    src/http/HttpResponse.cc
+    src/http/HttpContext.cc
+    src/http/ThreadPlacement.cc
+    src/http/VirtualHost.cc
+    src/router/Router.cc
+    src/router/RouteTree.cc
+    src/metrics/Metrics.cc
+    src/trace/Tracer.cc
+    src/middleware/MiddlewareChain.cc
+    src/middleware/cors/CorsMiddleware.cc
+    src/middleware/cors/CorsPolicy.cc
+    src/middleware/cache/CacheMiddleware.cc
+    src/middleware/ratelimit/RateLimitMiddleware.cc
+    src/middleware/auth/JwtMiddleware.cc
+    src/middleware/tracing/TracingMiddleware.cc
+    src/session/Session.cc
+    src/session/SessionManager.cc
+    src/session/SessionStorage.cc
+    src/session/RedisSessionStorage.cc
+    src/session/MysqlSessionStorage.cc
+    src/session/CookieSessionCodec.cc
+    src/ssl/SslContext.cc
+    src/ssl/SslConnection.cc
+    src/ssl/SslConfig.cc
+    src/utils/db/DbConnection.cc
+    src/utils/db/DbConnectionPool.cc
+"
+
+echo "[1] Compiling testServer and loadgen (-O2)..."
+g++ -std=c++17 -O2 -DNDEBUG -Wall -Wextra $SERVER_SOURCES examples/testServer.cc \
+    -I./include -o "$BUILD_DIR/testServer" \
+    -lmuduo_net -lmuduo_base -lssl -lcrypto -lpthread -lmysqlcppconn
+g++ -std=c++17 -O2 -DNDEBUG -Wall -Wextra benchmark/LoadGenerator.cc src/metrics/Metrics.cc \
+    -I./include -o "$BUILD_DIR/loadgen" \
+    -lmuduo_net -lmuduo_base -lssl -lcrypto -lpthread
+
+SERVER_PID=""
+SERVER_MODE=""
+
+stop_server()
+{
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+        SERVER_PID=""
+        SERVER_MODE=""
+    fi
+}
+trap stop_server EXIT
+
+# 参数: plain | tls
+start_server()
+{
+    if [ "$SERVER_MODE" == "$1" ]; then
+        return
+    fi
+    stop_server
+
+    local flags="--quiet --threads $SERVER_THREADS"
+    if [ "$1" == "plain" ]; then
+        flags="$flags --plain"
+    fi
+
+    # testServer 从当前目录读取 server.crt / server.key
+    taskset -c "$SERVER_CPUS" "$BUILD_DIR/testServer" $flags > "$RESULT_DIR/server-$1.log" 2>&1 &
+    SERVER_PID=$!
+    SERVER_MODE="$1"
+    sleep 1
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+        echo "testServer failed to start, see $RESULT_DIR/server-$1.log"
+        exit 1
+    fi
+}
+
+# 参数: 场景名 服务端模式 loadgen参数...
+run_scenario()
+{
+    local name="$1"
+    local mode="$2"
+    shift 2
+
+    start_server "$mode"
+    echo ""
+    echo "==> $name"
+    taskset -c "$CLIENT_CPUS" "$BUILD_DIR/loadgen" \
+        -t "$CLIENT_THREADS" -c "$CONNECTIONS" -d "$DURATION" -w "$WARMUP" \
+        -o "$RESULT_DIR/$name.hgrm" "$@" 127.0.0.1:8080 | tee "$RESULT_DIR/$name.txt"
+
+    echo "$name $(grep '^RESULT' "$RESULT_DIR/$name.txt" | cut -d' ' -f2-)" >> "$RESULT_DIR/summary.txt"
+}
+
+# ==================== 场景定义 ====================
+# 名字前缀 plain- 的场景跑明文 HTTP，tls- 的场景跑 HTTPS
+
+scenario()
+{
+    case "$1" in
+        plain-get)          run_scenario "$1" plain -u /api/status ;;
+        plain-get-pipeline) run_scenario "$1" plain -u /api/status -p 16 ;;
+        plain-get-html)     run_scenario "$1" plain -u / ;;
+        plain-post-echo)    run_scenario "$1" plain -m POST -u /api/echo \
+                                -H "Content-Type: application/json" -b '{"message":"hello benchmark"}' ;;
+        plain-get-openloop) run_scenario "$1" plain -u /api/status -r "$RATE" ;;
+        plain-get-close)    run_scenario "$1" plain -u /api/status -k ;;
+        plain-not-found)    run_scenario "$1" plain -u /not/found ;;
+        tls-get)            run_scenario "$1" tls -u /api/status -s ;;
+        tls-get-openloop)   run_scenario "$1" tls -u /api/status -s -r "$RATE" ;;
+        tls-get-close)      run_scenario "$1" tls -u /api/status -s -k ;;
+        *) echo "unknown scenario: $1"; exit 1 ;;
+    esac
+}
+
+ALL_SCENARIOS="plain-get plain-get-pipeline plain-get-html plain-post-echo plain-get-openloop
+               plain-get-close plain-not-found tls-get tls-get-openloop tls-get-close"
+
+SCENARIOS="$*"
+if [ -z "$SCENARIOS" ]; then
+    SCENARIOS="$ALL_SCENARIOS"
+fi
+
+echo "server cpus: $SERVER_CPUS  client cpus: $CLIENT_CPUS  results: $RESULT_DIR"
+for s in $SCENARIOS; do
+    scenario "$s"
+done
+stop_server
+
+echo ""
+echo "==================================="
+echo "  Summary ($RESULT_DIR/summary.txt)"
+echo "==================================="
+cat "$RESULT_DIR/summary.txt"
+
+# ==================== 和基线对比 ====================
+if [ -n "$BASELINE" ]; then
+    echo ""
+    echo "Comparing with $BASELINE (rps -${RPS_THRESHOLD}% / p99 +${P99_THRESHOLD}%)"
+    awk -v rpsT="$RPS_THRESHOLD" -v p99T="$P99_THRESHOLD" '
+        function field(line, key,    n, i, kv) {
+            n = split(line, kv, " ")
+            for (i = 2; i <= n; ++i) {
+                if (index(kv[i], key "=") == 1) return substr(kv[i], length(key) + 2) + 0
+            }
+            return 0
+        }
+        NR == FNR { base[$1] = $0; next }
+        ($1 in base) {
+            oldRps = field(base[$1], "rps"); newRps = field($0, "rps")
+            oldP99 = field(base[$1], "p99_us"); newP99 = field($0, "p99_us")
+            rpsDelta = oldRps > 0 ? (newRps - oldRps) * 100 / oldRps : 0
+            p99Delta = oldP99 > 0 ? (newP99 - oldP99) * 100 / oldP99 : 0
+            status = "ok"
+            if (rpsDelta < -rpsT || p99Delta > p99T) { status = "REGRESSION"; failed = 1 }
+            printf "  %-20s rps %10.1f -> %10.1f (%+6.1f%%)  p99 %8d -> %8d us (%+6.1f%%)  %s\n",
+                   $1, oldRps, newRps, rpsDelta, oldP99, newP99, p99Delta, status
+        }
+        END { exit failed }
+    ' "$BASELINE/summary.txt" "$RESULT_DIR/summary.txt"
+fi
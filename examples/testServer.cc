@@ -5,6 +5,7 @@
 #include <muduo/base/Logging.h>
 #include <iostream>
 #include <sstream>
+#include <cstring>
 #include <ctime>
 
 using namespace http;
@@ -150,11 +151,45 @@ void handleCreateUser(const HttpRequest& /* req */, HttpResponse* resp) {
     resp->setBody(body);
 }
 
+// ==================== 编译期路由表 ====================
+// 这几个接口的路径是固定的，放到编译期路由表里面，查找不需要遍历 radix tree，处理函数可以被内联
+
+struct StatusRoute : router::StaticRoute<HttpRequest::kGet, handleStatus> {
+    static constexpr std::string_view path = "/api/status";
+};
+
+struct TimeRoute : router::StaticRoute<HttpRequest::kGet, handleTime> {
+    static constexpr std::string_view path = "/api/time";
+};
+
+struct EchoRoute : router::StaticRoute<HttpRequest::kPost, handleEcho> {
+    static constexpr std::string_view path = "/api/echo";
+};
+
+using ApiRoutes = router::StaticRouteTable<StatusRoute, TimeRoute, EchoRoute>;
+
 // ==================== 主程序 ====================
 
-int main(int /* argc */, char** /* argv */) {
+// 用法: ./testServer [--plain] [--threads N] [--quiet]
+//      --plain     不开启 SSL，压测明文 HTTP 的时候用
+//      --threads   IO 线程数
+//      --quiet     只打印 WARN 以上的日志，压测的时候每个请求打印日志会严重影响结果
+int main(int argc, char** argv) {
+    bool plain = false;
+    int numThreads = 0;
+    bool quiet = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--plain") == 0) {
+            plain = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        }
+    }
+
     // 设置日志级别
-    muduo::Logger::setLogLevel(muduo::Logger::INFO);
+    muduo::Logger::setLogLevel(quiet ? muduo::Logger::WARN : muduo::Logger::INFO);
     
     LOG_INFO << "====================================";
     LOG_INFO << "  HTTP Server - Starting";
@@ -163,12 +198,15 @@ int main(int /* argc */, char** /* argv */) {
     try {
         // 1. 创建 HTTP Server（监听 8080 端口）
         ssl::SslConfig sslConfig;
-        sslConfig.setCertificateFile("./server.crt");
-        sslConfig.setPrivateKeyFile("./server.key");
+        if (!plain) {
+            sslConfig.setCertificateFile("./server.crt");
+            sslConfig.setPrivateKeyFile("./server.key");
+        }
         // 默认server 构造的 sslConfig 参数是空的，所以如果我们不指定，就是不开启SSL
 
         // 创建 Server 的时候直接传入配置，会在内部initialize完成所有初始化
         HttpServer server(8080, "TestHttpServer", sslConfig);
+        server.setThreadNum(numThreads);
 
         // 2. 配置 CORS（允许跨域请求）
         CorsConfig corsConfig;
@@ -183,12 +221,13 @@ int main(int /* argc */, char** /* argv */) {
         LOG_INFO << "✓ CORS Middleware configured";
 
         // 3. 注册路由处理函数
+        server.setStaticRoutes<ApiRoutes>();
         server.Get("/", handleIndex);
-        server.Get("/api/status", handleStatus);
-        server.Get("/api/time", handleTime);
-        server.Post("/api/echo", handleEcho);
         server.Get("/api/users", handleGetUsers);
         server.Post("/api/users", handleCreateUser);
+
+        // 4. 开启指标统计，Prometheus 从 /metrics 抓取
+        server.enableMetrics("/metrics");
         
         
         LOG_INFO << "✓ Routes registered:";
@@ -198,8 +237,9 @@ int main(int /* argc */, char** /* argv */) {
         LOG_INFO << "  - POST /api/echo";
         LOG_INFO << "  - GET  /api/users";
         LOG_INFO << "  - POST /api/users";
+        LOG_INFO << "  - GET  /metrics";
         
-        // 4. 启动服务器
+        // 5. 启动服务器
         LOG_INFO << "====================================";
         LOG_INFO << "  Server listening on 127.0.0.1:8080";
         LOG_INFO << "====================================";
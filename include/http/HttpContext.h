@@ -31,6 +31,7 @@ public:
 
     HttpContext()
         : state_(kExpectRequestLine)  // 增量解析，初始解析状态为解析请求行
+        , parked_(false)
     {}
 
     bool parseRequest(muduo::net::Buffer* buf, muduo::Timestamp receiveTime);
@@ -50,10 +51,18 @@ public:
     HttpRequest& request()
     { return request_; }
 
+    // 有一个请求被挂起(见 ParkedRequest)，它的响应发出去之前后面的请求先留在缓冲区里面
+    void setParked(bool parked)
+    { parked_ = parked; }
+
+    bool parked() const
+    { return parked_; }
+
 private:
     bool processRequestLine(const char* begin, const char* end);
     HttpRequestParseState   state_;
     HttpRequest             request_;
+    bool                    parked_;
 };
 
 } // namespace http
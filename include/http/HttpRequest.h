@@ -1,13 +1,27 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <map>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <muduo/base/Timestamp.h>
+#include <nlohmann/json_fwd.hpp>
+
+#include "ParkedRequest.h"
 
 namespace http
 {
 
+namespace trace
+{
+struct RequestTrace;
+}
+
 class HttpRequest
 {
 public:
@@ -16,25 +30,77 @@ public:
         kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions
     };
 
+    // {uuid:uuid} 这种路径参数解析出来的 16 个字节
+    using Uuid = std::array<uint8_t, 16>;
+
     HttpRequest()
         : method_(kInvalid)
         , version_("Unknown")
     {}
 
+    // 请求只能移动不能拷贝：从 HttpContext 经过中间件、路由到处理器全程都是引用，
+    // 避免像以前那样为了改一个字段把整个请求(包括可能很大的 body)拷贝一份
+    HttpRequest(const HttpRequest&) = delete;
+    HttpRequest& operator=(const HttpRequest&) = delete;
+    HttpRequest(HttpRequest&&) = default;
+    HttpRequest& operator=(HttpRequest&&) = default;
+
     void setReceiveTime(muduo::Timestamp t);
     muduo::Timestamp receiveTime() const {return receiveTime_;}
 
+    // 对端的 IP 地址，限流之类需要区分客户端的中间件会用到
+    void setPeerIp(const std::string& ip) {peerIp_ = ip;}
+    const std::string& peerIp() const {return peerIp_;}
+
+    // 认证中间件验证通过之后挂上来的 token 内容(JWT 的 payload)，没有认证的请求是空指针
+    // 验证结果会被缓存，同一个 token 的请求共享同一份 claims，所以是只读的
+    void setClaims(std::shared_ptr<const nlohmann::json> claims) {claims_ = std::move(claims);}
+    const nlohmann::json* claims() const {return claims_.get();}
+
+    // 追踪打开的时候 HttpServer 解析完请求挂上来，各个阶段往里面记录耗时，没有打开的时候是空指针
+    void setTrace(std::shared_ptr<trace::RequestTrace> trace) {trace_ = std::move(trace);}
+    trace::RequestTrace* trace() const {return trace_.get();}
+    std::shared_ptr<trace::RequestTrace> releaseTrace() {return std::move(trace_);}
+
+    // 中间件暂时给不出响应的时候挂起这个请求，见 ParkedRequest
+    // 只有 HttpServer 驱动的请求可以挂起(setParkable)，其它情况返回空，调用方要自己处理
+    std::shared_ptr<ParkedRequest> park()
+    {
+        if(parkable_ && !parked_)
+        {
+            parked_ = std::make_shared<ParkedRequest>();
+        }
+        return parked_;
+    }
+    bool parked() const {return parked_ != nullptr;}
+    std::shared_ptr<ParkedRequest> releaseParked() {return std::move(parked_);}
+    void setParkable(bool parkable) {parkable_ = parkable;}
+
+    // 挂起之后恢复、重新处理的请求，前面已经执行过一次的中间件可以据此跳过只应该做一次的事情(例如限流计数)
+    void setResumed() {resumed_ = true;}
+    bool resumed() const {return resumed_;}
+
     bool setMethod(const char* start, const char* end);
     Method method() const {return method_; }
+    static const char* methodString(Method method);
     
     void setPath(const char* start, const char* end);
-    std::string path() const {return path_;}
+    const std::string& path() const {return path_;}
 
     void setPathParameters(const std::string &key, const std::string &value);
     std::string getPathParameters(const std::string& key) const;
 
+    // 带类型的路径参数，例如 /users/{id:int}，路由匹配的时候已经解析好了，处理器不需要再解析一遍
+    // 参数不存在(或者不是这个类型)的时候返回 false
+    void setPathParameters(const std::string& key, int64_t value);
+    void setPathParameters(const std::string& key, const Uuid& value);
+    bool getPathParameters(const std::string& key, int64_t& value) const;
+    bool getPathParameters(const std::string& key, Uuid& value) const;
+
     void setQueryParameters(const char* start, const char* end);
     std::string getQueryParameters(const std::string& key) const;
+    // 问号后面的原始查询字符串，不包括问号
+    const std::string& query() const {return query_;}
 
     void setVersion(std::string v)
     {
@@ -52,7 +118,17 @@ public:
     const std::map<std::string, std::string>& headers() const
     { return headers_;}
 
+    // 一个 cookie 的名字和值，指向 Cookie 请求头的内容，不拷贝；请求对象销毁或者 Cookie 头被替换之后失效
+    using CookieView = std::pair<std::string_view, std::string_view>;
+
+    // Cookie 请求头按 RFC 6265 解析出来的所有 cookie，按出现的顺序
+    // 第一次调用的时候才解析，同一个请求里面会话、限流这些地方共用同一次解析的结果
+    const std::vector<CookieView>& cookies() const;
+    // 名字完整匹配(区分大小写)，同名的取第一个；没有这个 cookie 的时候返回 false
+    bool getCookie(std::string_view name, std::string_view& value) const;
+
     void setBody(const std::string& body) {content_ = body;}
+    void setBody(std::string&& body) {content_ = std::move(body);}
     void setBody(const char* start, const char* end)
     {
         if(end >= start)
@@ -61,7 +137,7 @@ public:
         }
     }
 
-    std::string getBody() const
+    const std::string& getBody() const
     { return content_; }
 
     void setContentLength(uint64_t length)
@@ -77,9 +153,20 @@ private:
     std::string         version_;       // http 版本
     std::string         path_;          // 请求路径
     std::unordered_map<std::string, std::string> pathParameters_; // 路径参数
+    std::unordered_map<std::string, int64_t> intPathParameters_;  // {name:int} 解析出来的值
+    std::unordered_map<std::string, Uuid> uuidPathParameters_;    // {name:uuid} 解析出来的值
     std::unordered_map<std::string, std::string> queryParameters_; // 查询参数
+    std::string         query_;         // 原始查询字符串
     muduo::Timestamp    receiveTime_; // 接收时间
+    std::string         peerIp_;        // 对端 IP
+    std::shared_ptr<const nlohmann::json> claims_; // 认证之后的 token 内容
+    std::shared_ptr<trace::RequestTrace> trace_;   // 请求追踪
+    std::shared_ptr<ParkedRequest> parked_;        // 这次处理中被中间件挂起了
+    bool                parkable_ { false };
+    bool                resumed_ { false };
     std::map<std::string, std::string> headers_; // 请求头
+    mutable std::vector<CookieView> cookies_;    // 解析过的 Cookie 请求头，指向 headers_ 里面的值
+    mutable bool        cookiesParsed_ { false };
     std::string         content_;       // 请求体
     uint64_t            contentLength_ { 0 }; // 请求体长度 
 };
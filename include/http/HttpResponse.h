@@ -2,6 +2,8 @@
 
 #include <muduo/net/TcpServer.h>
 
+#include <map>
+#include <memory>
 #include <string>
 
 
@@ -30,17 +32,20 @@ public:
         k200Ok = 200,
         k204NoContent = 204,
         k301MovedPermanently = 301,
+        k304NotModified = 304,
         k400BadRequest = 400,
         k401Unauthorized = 401,
         k403Forbidden = 403,
         k404NotFound = 404,
         k409Conflict = 409,
+        k429TooManyRequests = 429,
         k500InternalServerError = 500,
     };
 
     HttpResponse(bool close = true)
         : statusCode_(kUnknown)
         , closeConnection_(close)
+        , isFile_(false)
     {}
 
     void setVersion(std::string version)
@@ -55,6 +60,9 @@ public:
     void setStatusMessage(const std::string message)
     { statusMessage_ = message; }
 
+    const std::string& getStatusMessage() const
+    { return statusMessage_; }
+
     // 用于标记服务器在发送完这个响应后是否要关闭 TCP 连接
     // 通常我们 构造函数，默认是简单连接(HTTP/1.0 客户端)
     // 而对应的  HTTP/1.1 默认是保持连接的, 也就是 keep-alive
@@ -73,6 +81,9 @@ public:
     void addHeader(const std::string& key, const std::string& value)
     { headers_[key] = value; }
 
+    const std::map<std::string, std::string>& headers() const
+    { return headers_; }
+
     void setBody(const std::string& body)
     {
         body_ = body;
@@ -87,6 +98,17 @@ public:
 
     void appendToBuffer(muduo::net::Buffer* outputBuf) const;
 
+    // 把响应头(不包括状态行和 Connection)和 body 序列化成一段字节，格式和 appendToBuffer 输出的一致
+    std::string renderHeadersAndBody() const;
+
+    // 直接使用预先序列化好的响应头和 body(响应缓存命中的时候用)，
+    // 设置了之后 appendToBuffer 输出状态行、Connection、之后 addHeader 加上的响应头，然后是这段字节，body_ 不再使用
+    void setPrerendered(std::shared_ptr<const std::string> bytes)
+    { prerendered_ = std::move(bytes); }
+
+private:
+    void appendHeadersAndBody(muduo::net::Buffer* outputBuf) const;
+
 private:
     std::string             httpVersion_;
     HttpStatusCode          statusCode_;
@@ -95,6 +117,7 @@ private:
     std::map<std::string, std::string>      headers_;
     std::string             body_;
     bool                    isFile_;
+    std::shared_ptr<const std::string>      prerendered_;   // 预先序列化好的响应头和 body
 };
 
 }  // namespace http
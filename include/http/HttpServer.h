@@ -4,20 +4,26 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
 #include <muduo/base/Logging.h>
 
 #include "HttpContext.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
+#include "ThreadPlacement.h"
+#include "VirtualHost.h"
 #include "../router/Router.h"
+#include "../metrics/Metrics.h"
 #include "../session/SessionManager.h"
 #include "../middleware/MiddlewareChain.h"
 #include "../middleware/cors/CorsMiddleware.h"
@@ -45,6 +51,8 @@ class HttpServer : muduo::noncopyable
 {
 public:
     using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+    // 服务器内部使用的请求处理函数，拿到的是 HttpContext 里面那个请求本身，可以就地修改，不需要拷贝
+    using RequestHandler = std::function<void (HttpRequest&, HttpResponse*)>;
 
     HttpServer(int port,
             const std::string& name,
@@ -56,6 +64,9 @@ public:
         server_.setThreadNum(numThreads);
     }
 
+    // 设置 mainLoop 和 IO loop 的 CPU 绑定策略，必须在 start() 之前调用
+    void setThreadPlacement(const ThreadPlacement& placement);
+
     void start();
 
     muduo::net::EventLoop* getLoop() const{
@@ -68,39 +79,60 @@ public:
         httpCallback_ = cb;
     }
 
+    // 下面这些注册接口都是注册到默认主机上的
+    // 服务器启动之后也可以调用，新的路由表原子地发布，正在处理的请求不受影响
+
     // 注册静态路由处理器
     void Get(const std::string& path, const HttpCallback& cb)
     {
-        router_.registerCallback(HttpRequest::kGet, path, cb);
+        defaultHost_.Get(path, cb);
     }
 
     // 注册静态路由处理器
     void Get(const std::string& path, router::Router::HandlerPtr handler)
     {
-        router_.registerHandler(HttpRequest::Method::kGet, path, handler);
+        defaultHost_.Get(path, handler);
     }
 
     void Post(const std::string& path, const HttpCallback& cb)
     {
-        router_.registerCallback(HttpRequest::kPost, path, cb);
+        defaultHost_.Post(path, cb);
     }
 
     void Post(const std::string& path, router::Router::HandlerPtr handler)
     {
-        router_.registerHandler(HttpRequest::kPost, path, handler);
+        defaultHost_.Post(path, handler);
     }
 
-    // 注册动态路由处理函数
+    // 注册动态路由处理函数，例如 /users/:id、/users/{id:int}、/posts/{slug:[a-z0-9-]+}、/static/*filepath
     void addRoute(HttpRequest::Method method, const std::string& path, router::Router::HandlerPtr handler)
     {
-        router_.addRegexHandler(method, path, handler);
+        defaultHost_.addRoute(method, path, handler);
     }
 
     void addRoute(HttpRequest::Method method, const std::string& path, const router::Router::HandlerCallback& cb)
     {
-        router_.addRegexCallback(method, path, cb);
+        defaultHost_.addRoute(method, path, cb);
     }
 
+    // 运行时删除路由
+    bool removeRoute(HttpRequest::Method method, const std::string& path)
+    {
+        return defaultHost_.removeRoute(method, path);
+    }
+
+    // 挂上编译期路由表，见 router/StaticRouteTable.h，和上面注册的运行时路由可以同时使用
+    template <typename Table>
+    void setStaticRoutes()
+    {
+        defaultHost_.setStaticRoutes<Table>();
+    }
+
+    // 按 Host 请求头分发的虚拟主机，有自己的路由表和中间件链，必须在 start() 之前添加
+    // host 可以是 api.example.com 这样的完整主机名，也可以是 *.example.com 匹配所有子域名
+    // 完整主机名优先，然后是最长的通配后缀，都匹配不上的交给默认主机；同一个名字添加两次返回同一个对象
+    VirtualHost& addVirtualHost(const std::string& host);
+
     // 设置会话管理
     void setSessionManager(std::unique_ptr<session::SessionManager> manager)
     {
@@ -112,12 +144,21 @@ public:
         return sessionManager_.get();
     }
 
-    // 添加中间件的方法
+    // 添加中间件的方法，只作用于默认主机，虚拟主机用自己的 addMiddleware
     void addMiddleware(std::shared_ptr<middleware::Middleware> middleware)
     {
-        middlewareChain_.addMiddleware(middleware);
+        defaultHost_.addMiddleware(middleware);
+    }
+
+    // 只给默认主机上 prefix 下面的路由添加中间件，例如 addMiddleware("/api", auth)
+    void addMiddleware(const std::string& prefix, std::shared_ptr<middleware::Middleware> middleware)
+    {
+        defaultHost_.addMiddleware(prefix, middleware);
     }
 
+    // 开启指标统计，并在 path 上注册 Prometheus 抓取接口
+    void enableMetrics(const std::string& path = "/metrics");
+
     void enableSSL(bool enable)
     {
         useSSL_ = enable;
@@ -129,25 +170,36 @@ public:
 
 private:
     void initialize(const ssl::SslConfig& config);
+    void onThreadInit(muduo::net::EventLoop* loop);
     void onConnection(const muduo::net::TcpConnectionPtr& conn);
     void onMessage(const muduo::net::TcpConnectionPtr&conn,
                     muduo::net::Buffer* buf,
                     muduo::Timestamp receiveTime);
-    void onRequest(const muduo::net::TcpConnectionPtr&, const HttpRequest&);
-    void handleRequest(const HttpRequest& req, HttpResponse* resp);
+    void onRequest(const muduo::net::TcpConnectionPtr&, HttpRequest&);
+    // 中间件挂起了请求(见 ParkedRequest)：保存请求，暂停这个连接上后面的请求，恢复的时候重新处理
+    void parkRequest(const muduo::net::TcpConnectionPtr& conn, muduo::net::Buffer* buf,
+                     HttpContext* context, HttpRequest& req);
+    void resumeRequest(const muduo::net::TcpConnectionPtr& conn, const std::shared_ptr<HttpRequest>& req,
+                       muduo::net::Buffer* buf);
+    void handleRequest(HttpRequest& req, HttpResponse* resp);
+    VirtualHost& selectHost(const HttpRequest& req);
+    void reclaimAfterQuiescence(std::function<void()> reclaim);
 
 private:
     muduo::net::InetAddress                         listenAddr_;        // 监听地址, 给TcpServer 初始化用的
     muduo::net::TcpServer                           server_;
     muduo::net::EventLoop                           mainLoop_;          // 主循环
-    HttpCallback                                    httpCallback_;      // 回调
-    router::Router                                  router_;            // 路由
+    RequestHandler                                  httpCallback_;      // 回调
+    VirtualHost                                     defaultHost_;       // 默认主机的路由和中间链
+    std::unordered_map<std::string, std::unique_ptr<VirtualHost>> hosts_;   // 规范化之后的主机名 -> 虚拟主机
+    std::vector<std::pair<std::string, VirtualHost*>> wildcardHosts_;   // *.example.com 存成 .example.com，长的在前面
     std::unique_ptr<session::SessionManager>        sessionManager_;    // 路由管理
-    middleware::MiddlewareChain                     middlewareChain_;   // 中间链
     std::unique_ptr<ssl::SslContext>                sslCtx_;            // SSL 上下文
     bool                                            useSSL_;            // 是否使用SSL
     // TcpConnectionPtr   ->   SslConnectionPtr
     std::map<muduo::net::TcpConnectionPtr, std::unique_ptr<ssl::SslConnection>> sslConnections_;
+    ThreadPlacement                                 placement_;         // 线程绑核策略
+    std::atomic<int>                                nextIoLoop_ { 0 };  // 下一个启动的 IO loop 的序号
 };
 
 
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+
+namespace http
+{
+
+// 挂起的请求：中间件暂时给不出响应(例如在等另一个请求的处理结果)，又不能阻塞 IO 线程的时候，
+// 在 before 里面调用 HttpRequest::park() 拿到它，然后返回 kRespond
+//      这次不发送响应，这个连接上后面的请求也先留在缓冲区里面不处理，保证响应的顺序
+//      以后在任意线程调用 resume()，请求回到它所在的 IO 线程上，从头再走一遍中间件和路由，
+//      这时 HttpRequest::resumed() 为 true，挂起它的中间件据此决定不再挂起第二次
+//
+// 挂起的一方要保证最后一定会 resume(例如同时设置一个超时)，不然这个连接上的请求会一直等下去
+class ParkedRequest
+{
+public:
+    using Resumer = std::function<void()>;
+
+    // 只有第一次调用有效
+    void resume()
+    {
+        Resumer resumer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(resumed_)
+            {
+                return;
+            }
+            resumed_ = true;
+            resumer = std::move(resumer_);
+        }
+        // 还没有 bind 的时候 resumer 为空，bind 的时候发现已经 resume 过了会马上恢复
+        if(resumer)
+        {
+            resumer();
+        }
+    }
+
+    // HttpServer 在这次处理结束之后设置怎么恢复这个请求，resumer 负责切换到请求所在的 IO 线程
+    void bind(Resumer resumer)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(!resumed_)
+            {
+                resumer_ = std::move(resumer);
+                return;
+            }
+        }
+        resumer();
+    }
+
+private:
+    std::mutex  mutex_;
+    bool        resumed_ = false;
+    Resumer     resumer_;
+};
+
+} // namespace http
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * IO 线程的放置策略：把 mainLoop 和每个 IO loop 绑定到指定的 CPU 集合上
+ *
+ * muduo 默认让操作系统随意调度 IO 线程，线程在核之间迁移会导致 cache 失效，
+ * 并且和网卡中断抢同一个核。这里提供三种常见的配置方式：
+ *      1. 手动指定每个 loop 的 CPU 集合
+ *      2. fromNumaNode: 所有 loop 放在同一个 NUMA 节点上，每个 loop 占一个核
+ *      3. fromNicQueues: 按照网卡 RX 队列的中断亲和性，让第 i 个 IO loop 跑在处理第 i 个队列中断的核上
+ *
+ * 绑定之后，如果 bindMemoryToNode 为 true，线程的内存分配策略会设置为优先使用本地 NUMA 节点，
+ * 每个 loop 自己分配的内存(Buffer、连接上下文、线程局部的统计数据等)就都来自本地内存
+*/
+
+namespace http
+{
+
+struct ThreadPlacement
+{
+    std::vector<int>                mainLoopCpus;           // mainLoop 绑定的 CPU，空表示不绑定
+    std::vector<std::vector<int>>   ioLoopCpus;             // 第 i 个 IO loop 绑定到 ioLoopCpus[i % size]
+    bool                            bindMemoryToNode = true; // 是否优先从本地 NUMA 节点分配内存
+
+    bool empty() const
+    { return mainLoopCpus.empty() && ioLoopCpus.empty(); }
+
+    // 在 NUMA 节点 node 上，mainLoop 占第一个核，之后每个 IO loop 各占一个核
+    static ThreadPlacement fromNumaNode(int node, int numThreads);
+
+    // 按网卡 RX 队列的中断亲和性放置 IO loop，mainLoop 放在不处理这些中断的核上
+    static ThreadPlacement fromNicQueues(const std::string& interface, int numThreads);
+
+    // 把当前线程绑定到 cpus 上，cpus 为空时什么也不做
+    static bool pinCurrentThread(const std::vector<int>& cpus);
+
+    // 把当前线程的内存分配策略设置为优先使用 cpus 所在的 NUMA 节点
+    static bool preferLocalMemory(const std::vector<int>& cpus);
+
+    // 解析 "0-3,8,10-11" 这种格式的 CPU 列表，格式不对的项跳过，不会抛异常
+    static std::vector<int> parseCpuList(const std::string& list);
+
+    static int numaNodeOfCpu(int cpu);
+    static std::vector<int> cpusOfNumaNode(int node);
+
+    // 按队列顺序返回处理网卡 RX 队列中断的 CPU
+    static std::vector<int> nicQueueCpus(const std::string& interface);
+};
+
+} // namespace http
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <muduo/base/noncopyable.h>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "../router/Router.h"
+#include "../middleware/MiddlewareChain.h"
+
+namespace http
+{
+
+// 一个虚拟主机：自己的路由表和中间件(中间件链按路由算好，存在路由表里面)
+// 同一个端口上的多个内部服务按 Host 请求头分到不同的 VirtualHost，共用一个进程和它的 IO 线程
+// HttpServer 自己的 Get/Post/addMiddleware 等接口注册到默认主机上，Host 没有匹配到任何虚拟主机的请求也交给默认主机
+class VirtualHost : muduo::noncopyable
+{
+public:
+    using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+
+    void Get(const std::string& path, const HttpCallback& cb)
+    {
+        router_.registerCallback(HttpRequest::kGet, path, cb);
+    }
+
+    void Get(const std::string& path, router::Router::HandlerPtr handler)
+    {
+        router_.registerHandler(HttpRequest::kGet, path, handler);
+    }
+
+    void Post(const std::string& path, const HttpCallback& cb)
+    {
+        router_.registerCallback(HttpRequest::kPost, path, cb);
+    }
+
+    void Post(const std::string& path, router::Router::HandlerPtr handler)
+    {
+        router_.registerHandler(HttpRequest::kPost, path, handler);
+    }
+
+    // 注册动态路由，例如 /users/:id、/users/{id:int}、/static/*filepath
+    void addRoute(HttpRequest::Method method, const std::string& path, router::Router::HandlerPtr handler)
+    {
+        router_.addPatternHandler(method, path, handler);
+    }
+
+    void addRoute(HttpRequest::Method method, const std::string& path, const router::Router::HandlerCallback& cb)
+    {
+        router_.addPatternCallback(method, path, cb);
+    }
+
+    // 运行时删除路由，见 Router 里面关于 RCU 的说明
+    bool removeRoute(HttpRequest::Method method, const std::string& path)
+    {
+        return router_.removeRoute(method, path);
+    }
+
+    template <typename Table>
+    void setStaticRoutes()
+    {
+        router_.setStaticRoutes<Table>();
+    }
+
+    // 作用于这个主机上的所有路由
+    void addMiddleware(std::shared_ptr<middleware::Middleware> middleware)
+    {
+        router_.addMiddleware("/", middleware);
+    }
+
+    // 只作用于 prefix 下面的路由，例如 /api，健康检查这种路由就不用经过它
+    void addMiddleware(const std::string& prefix, std::shared_ptr<middleware::Middleware> middleware)
+    {
+        router_.addMiddleware(prefix, middleware);
+    }
+
+    void setReclaimer(router::Router::Reclaimer reclaimer)
+    {
+        router_.setReclaimer(std::move(reclaimer));
+    }
+
+    // 路由 -> 这条路由的中间件 before -> 处理器 -> 中间件 after，没有匹配的路由时设置 404
+    void handle(HttpRequest& req, HttpResponse* resp);
+
+    // 把 Host 请求头规范化成查表用的名字：去掉端口，转成小写
+    // 例如 "API.Example.com:8080" -> "api.example.com"，"[::1]:8080" -> "[::1]"
+    static void normalizeHost(std::string_view host, std::string& out);
+
+private:
+    router::Router                  router_;
+};
+
+} // namespace http
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * 服务器内置的指标统计，抓取时以 Prometheus 文本格式输出
+ *
+ * 设计上的关键点是：热路径(IO线程处理请求)不做任何线程间共享的原子读-改-写
+ *      每个线程第一次记录指标时，会分配一份自己独占的 ThreadMetrics (按 cache line 对齐，避免伪共享)
+ *      之后该线程只写自己那一份，写法是 relaxed load + relaxed store，不会产生 lock 前缀的指令
+ *      抓取(scrape)的时候，再把所有线程的数据加起来，这时候只是读，同样不需要加锁
+ *
+ * 延迟用 HDR 风格的 log-linear 直方图记录：每个 2 的幂区间再均分成 16 个子桶，相对误差大约 3%
+*/
+
+namespace http
+{
+namespace metrics
+{
+
+// 单写者计数器：只有所属线程会写，其它线程只读
+class Counter
+{
+public:
+    void add(uint64_t n = 1)
+    { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    uint64_t value() const
+    { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_ { 0 };
+};
+
+// HDR 风格的延迟直方图，单位：微秒
+class LatencyHistogram
+{
+public:
+    static constexpr int      kSubBucketBits  = 5;                        // 小于 32us 的值精确记录
+    static constexpr int      kSubBucketHalf  = 1 << (kSubBucketBits - 1);
+    static constexpr int      kMaxValueBits   = 32;                       // 上限约 71 分钟，超过的按上限记录
+    static constexpr size_t   kBucketCount    = (1 << kSubBucketBits) + (kMaxValueBits - kSubBucketBits) * kSubBucketHalf;
+
+    void record(uint64_t micros);
+
+    // 把当前直方图累加到 buckets 中，抓取的时候用
+    void mergeInto(std::vector<uint64_t>& buckets, uint64_t& count, uint64_t& sum) const;
+
+    static size_t bucketIndex(uint64_t micros);
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    std::array<Counter, kBucketCount>   buckets_;
+    Counter                             count_;
+    Counter                             sum_;
+};
+
+// 每个线程独占一份，alignas(64) 保证不同线程的数据不会落在同一条 cache line 上
+struct alignas(64) ThreadMetrics
+{
+    static constexpr int kMaxStatusCode = 600;
+    static constexpr int kMaxRoutes     = 1024;
+
+    ThreadMetrics();
+    ~ThreadMetrics();
+
+    ThreadMetrics(const ThreadMetrics&) = delete;
+    ThreadMetrics& operator=(const ThreadMetrics&) = delete;
+
+    // 路由直方图由所属线程在第一次命中时分配，并用 release 发布给抓取线程
+    LatencyHistogram* routeHistogram(int routeId);
+
+    Counter                                     requests;               // 请求总数
+    std::array<Counter, kMaxStatusCode>         statusCodes;            // 按状态码统计
+    Counter                                     bytesIn;                // 解析掉的请求字节数
+    Counter                                     bytesOut;               // 发出的响应字节数(明文)
+    Counter                                     tlsHandshakes;          // TLS 握手成功次数
+    Counter                                     tlsHandshakeFailures;   // TLS 握手失败次数
+    LatencyHistogram                            requestLatency;         // 整个请求的处理延迟
+    std::array<std::atomic<LatencyHistogram*>, kMaxRoutes> routeLatency; // 每条路由的处理延迟
+};
+
+// 单例模式，和 DbConnectionPool 一样使用 local static
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry& getInstance()
+    {
+        static MetricsRegistry instance;
+        return instance;
+    }
+
+    void setEnabled(bool on)
+    { enabled_.store(on, std::memory_order_relaxed); }
+
+    bool enabled() const
+    { return enabled_.load(std::memory_order_relaxed); }
+
+    // 当前线程独占的指标，第一次调用时注册
+    ThreadMetrics& local();
+
+    // 注册路由，返回路由id，同一个 method + path 返回同一个id
+    int registerRoute(const std::string& method, const std::string& path);
+
+    // 汇总所有线程的数据，输出 Prometheus 文本格式
+    std::string renderPrometheus() const;
+
+private:
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+private:
+    mutable std::mutex                              mutex_;
+    std::vector<std::unique_ptr<ThreadMetrics>>     threads_;       // 线程退出后也不释放，保证计数单调递增
+    std::vector<std::string>                        routeLabels_;   // routeId -> 标签
+    std::unordered_map<std::string, int>            routeIds_;      // 标签 -> routeId
+    std::atomic<bool>                               enabled_ { false };
+};
+
+// 单调时钟，单位：微秒
+inline uint64_t nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// RAII 计时，析构的时候把耗时记到对应路由的直方图上
+class ScopedRouteTimer
+{
+public:
+    explicit ScopedRouteTimer(int routeId)
+        : routeId_(MetricsRegistry::getInstance().enabled() ? routeId : -1)
+        , start_(routeId_ >= 0 ? nowMicros() : 0)
+    {}
+
+    ~ScopedRouteTimer()
+    {
+        if(routeId_ >= 0)
+        {
+            LatencyHistogram* hist = MetricsRegistry::getInstance().local().routeHistogram(routeId_);
+            if(hist)
+            {
+                hist->record(nowMicros() - start_);
+            }
+        }
+    }
+
+    ScopedRouteTimer(const ScopedRouteTimer&) = delete;
+    ScopedRouteTimer& operator=(const ScopedRouteTimer&) = delete;
+
+private:
+    int         routeId_;
+    uint64_t    start_;
+};
+
+} // namespace metrics
+} // namespace http
@@ -13,13 +13,36 @@ class Middleware
 public:
     virtual ~Middleware() = default;
 
+    // before 的返回值
+    enum Action
+    {
+        kContinue,      // 继续执行后面的中间件和处理器
+        kRespond,       // 响应已经写到 response 里面了，不再往后执行，直接发回去
+    };
+
     // 一半来说，一个middle ware 包括三个基本函数：请求前处理， 相应后处理以及 next
-    // 请求前处理
-    virtual void before(HttpRequest& request) = 0;
+    // 请求前处理，response 就是最后要发出去的那个响应对象，需要提前结束的时候(CORS 预检、缓存命中)
+    // 直接填好它然后返回 kRespond，不用抛异常，也不会有响应对象的拷贝
+    // 暂时给不出响应又不能阻塞的时候，调用 request.park() 挂起请求再返回 kRespond，见 ParkedRequest
+    virtual Action before(HttpRequest& request, HttpResponse& response) = 0;
 
     // 响应后处理
     virtual void after(HttpResponse& resp) = 0;
 
+    // 需要同时看到请求和响应的中间件(例如响应缓存要知道缓存的 key)重写这个函数，
+    // 默认直接转给 after(resp)
+    virtual void afterRequest(const HttpRequest& request, HttpResponse& resp)
+    {
+        (void)request;
+        after(resp);
+    }
+
+    // 中间件的名字，请求追踪里面用来标记每个中间件花的时间，要返回静态的字符串
+    virtual const char* name() const
+    {
+        return "middleware";
+    }
+
     // 设置下一个中间件
     void setNext(std::shared_ptr<Middleware> next)
     {
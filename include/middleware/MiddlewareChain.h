@@ -13,8 +13,14 @@ class MiddlewareChain
 {
 public:
     void addMiddleware(std::shared_ptr<Middleware> middleware);
-    void processBefore(HttpRequest& request);
-    void processAfter(HttpResponse& response);
+    // 依次执行 before，某个中间件返回 kRespond 的时候停下来并返回 false
+    // entered 是 before 返回了 kContinue 的中间件个数，processAfter 只对这些中间件执行 after，
+    // 和洋葱模型一样：给出响应的那个中间件以及它后面的中间件都不执行 after
+    // 请求被挂起(HttpRequest::park)的时候 entered 为 0，这次所有中间件都不执行 after
+    bool processBefore(HttpRequest& request, HttpResponse& response, size_t& entered) const;
+    void processAfter(const HttpRequest& request, HttpResponse& response, size_t entered) const;
+
+    bool empty() const { return middlewares_.empty(); }
 
 private:
     std::vector<std::shared_ptr<Middleware>> middlewares_;
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+namespace http
+{
+namespace middleware
+{
+
+struct JwtConfig
+{
+    // 两种密钥至少配置一个，token 头里面的 alg 决定用哪一个：
+    //      HS256 / HS384 / HS512 用 hmacSecret
+    //      ES256 / ES384 / ES512 用 ecPublicKeyPem(PEM 格式的公钥)
+    // 没有配置对应密钥的算法一律拒绝，alg 为 none 的 token 也拒绝
+    std::string hmacSecret;
+    std::string ecPublicKeyPem;
+
+    std::string issuer;                 // 不为空的时候要求 iss 相等
+    std::string audience;               // 不为空的时候要求 aud 相等(或者包含在 aud 数组里面)
+    int leewaySeconds = 30;             // 检查 exp / nbf 时允许的时钟误差
+
+    size_t cacheSize = 1024;            // 每个 IO 线程缓存的验证结果数量
+    int maxCacheSeconds = 300;          // 没有 exp 的 token 验证结果最多缓存多久
+
+    bool optional = false;              // 为 true 的时候没有 token 的请求也放行，只是 request.claims() 为空
+
+    static JwtConfig defaultConfig()
+    {
+        return JwtConfig();
+    }
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "JwtConfig.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <muduo/base/noncopyable.h>
+#include <nlohmann/json.hpp>
+#include <openssl/evp.h>
+
+namespace http
+{
+namespace middleware
+{
+
+// Bearer token 认证：检查 Authorization: Bearer <JWT> 的签名、有效期、iss 和 aud，
+// 通过之后把 payload 挂到 request.setClaims() 上，处理器用 request.claims() 读取
+// 失败的时候返回 401 和 WWW-Authenticate，不再往后执行
+//
+// 同一个客户端会拿同一个 token 请求很多次，验证签名(特别是 ECDSA)比处理请求本身还贵，
+// 所以验证通过的结果按 token 的 SHA-256 缓存在每个 IO 线程自己的 LRU 里面(不需要加锁)，
+// 缓存到 token 过期为止，之后同一个 token 只需要算一次哈希
+//
+// 要和 CORS 一起用的话，CORS 要先添加，预检请求是不带 Authorization 的
+class JwtMiddleware : public Middleware, muduo::noncopyable
+{
+public:
+    explicit JwtMiddleware(const JwtConfig& config = JwtConfig::defaultConfig());
+    ~JwtMiddleware();
+
+    Action before(HttpRequest& request, HttpResponse& response) override;
+    void after(HttpResponse& response) override;
+    const char* name() const override { return "jwt"; }
+
+private:
+    struct CacheEntry
+    {
+        std::shared_ptr<const nlohmann::json> claims;
+        int64_t                 expiresAt;      // 秒，超过之后要重新验证(然后因为过期被拒绝)
+        std::list<std::string>::iterator lruIt;
+    };
+
+    struct TokenCache
+    {
+        std::unordered_map<std::string, CacheEntry> entries;   // key 是 token 的 SHA-256
+        std::list<std::string>                      lru;       // 前面是最近用过的
+    };
+
+    // 当前 IO 线程里面属于这个中间件实例的缓存
+    TokenCache& localCache() const;
+
+    // 验证通过返回 claims，失败返回空指针，expiresAt 是这个结果可以缓存到的时间
+    std::shared_ptr<const nlohmann::json> verify(const std::string& token, int64_t now, int64_t& expiresAt) const;
+    bool verifySignature(const std::string& alg, const std::string& signingInput, const std::string& signature) const;
+    bool checkClaims(const nlohmann::json& claims, int64_t now) const;
+
+    static Action reject(HttpResponse& response, const char* error);
+
+private:
+    JwtConfig   config_;
+    EVP_PKEY*   ecKey_;         // 没有配置 ECDSA 公钥的时候为空
+    uint64_t    id_;            // 区分线程局部缓存里面不同的中间件实例
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace http
+{
+namespace middleware
+{
+
+// 每条路由自己的缓存策略
+struct CacheRule
+{
+    int ttlMs = 1000;                       // 缓存的新鲜期
+    int staleWhileRevalidateMs = 0;         // 过期之后还可以返回旧响应的时间，这段时间里面只有一个请求去刷新
+    std::vector<std::string> varyHeaders;   // 这些请求头的值也是缓存 key 的一部分，例如 Accept-Encoding
+};
+
+struct CacheConfig
+{
+    // key 是请求路径(精确匹配)，只缓存 GET 和 HEAD 请求
+    std::unordered_map<std::string, CacheRule> routes;
+
+    size_t maxEntries = 10000;              // 缓存条目的上限，超过之后淘汰最久没有用过的
+    size_t maxResponseSize = 1 << 20;       // 序列化之后超过这个大小的响应不缓存
+    int coalesceTimeoutMs = 1000;           // 拿到刷新权的请求最多占用这么久，超时之后其它请求可以接手刷新；
+                                            // 也是挂起的请求最多等待的时间
+
+    void cache(const std::string& path, int ttlMs, int staleWhileRevalidateMs = 0)
+    {
+        CacheRule rule;
+        rule.ttlMs = ttlMs;
+        rule.staleWhileRevalidateMs = staleWhileRevalidateMs;
+        routes[path] = rule;
+    }
+
+    static CacheConfig defaultConfig()
+    {
+        return CacheConfig();
+    }
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "../../http/ParkedRequest.h"
+#include "CacheConfig.h"
+
+#include <array>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace http
+{
+namespace middleware
+{
+
+// 响应微缓存：同一个 GET 在很短的时间(通常一两秒)内重复出现的时候，直接返回缓存的响应，不再执行处理器
+//
+// 缓存的 key 是 method + path + 查询字符串 + 路由配置的 Vary 请求头的值，
+// 缓存的内容是序列化好的响应头和 body，命中的时候直接输出这段字节
+//
+// 同一个 key 同时有多个请求没有命中的时候，只有第一个请求拿到刷新权去执行处理器：
+//      在 stale-while-revalidate 期间，其它请求直接返回旧响应
+//      没有可以返回的响应的时候，其它请求挂起(HttpRequest::park，不阻塞 IO 线程)，
+//      拿到刷新权的请求结束的时候把它们投递回各自的 IO 线程，重新查一遍缓存
+//      挂起的请求最多等 coalesceTimeoutMs，超时之后或者已经挂起过一次，有过期的响应就返回过期的响应，
+//      连过期的响应都没有才自己执行处理器
+//      拿到刷新权的请求超过 coalesceTimeoutMs 还没有结果，其它请求可以接手刷新
+//
+// 处理器执行完之后缓存的是这个中间件的 after 阶段时的响应，包括后面添加的中间件在 after 阶段加上的响应头；
+// 命中的时候后面的中间件都不会执行，前面添加的中间件照常执行 after，它们加的响应头会加在缓存的字节前面输出
+//
+// 随请求变化的响应头(例如 CORS 反射的 Access-Control-Allow-Origin)一定要通过 Vary 声明，
+// 响应的 Vary 里面有不在路由 varyHeaders 里面的请求头的时候不缓存，需要缓存的话把它加到 varyHeaders 里面
+class CacheMiddleware : public Middleware
+{
+public:
+    explicit CacheMiddleware(const CacheConfig& config = CacheConfig::defaultConfig());
+
+    Action before(HttpRequest& request, HttpResponse& response) override;
+    void after(HttpResponse& response) override;
+    void afterRequest(const HttpRequest& request, HttpResponse& response) override;
+    const char* name() const override { return "cache"; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct CachedResponse
+    {
+        HttpResponse::HttpStatusCode    statusCode;
+        std::string                     statusMessage;
+        std::shared_ptr<const std::string> bytes;   // 序列化好的响应头和 body
+    };
+
+    using Waiters = std::vector<std::shared_ptr<ParkedRequest>>;
+
+    struct Entry
+    {
+        std::shared_ptr<const CachedResponse> response;    // 为空表示第一个请求还没有回来
+        Clock::time_point   freshUntil;
+        Clock::time_point   staleUntil;
+        bool                refreshing = false;             // 已经有一个请求拿到了刷新权
+        Clock::time_point   leaseUntil;                     // 超过这个时间还没有结果，其它请求可以接手刷新
+        Waiters             waiters;                        // 等刷新结果的挂起请求
+        std::list<std::string>::iterator lruIt;
+    };
+
+    // 按 key 的哈希分片，每个分片一把锁，减少 IO 线程之间的竞争
+    struct Shard
+    {
+        std::mutex                              mutex;
+        std::unordered_map<std::string, Entry>  entries;
+        std::list<std::string>                  lru;        // 前面是最近用过的
+    };
+
+    static constexpr size_t kShardCount = 16;
+
+    const CacheRule* findRule(const HttpRequest& request) const;
+    // 响应的 Vary 里面的请求头是不是都在缓存 key 里面
+    static bool varyCoveredByKey(const HttpResponse& response, const CacheRule& rule);
+    static std::string makeKey(const HttpRequest& request, const CacheRule& rule);
+    // 名字不区分大小写，没有的时候返回空字符串
+    static const std::string& headerValue(const HttpRequest& request, const std::string& name);
+    Shard& shardFor(const std::string& key);
+
+    // 淘汰掉的条目上挂起的请求放到 evicted 里面，由调用者放开锁之后 resumeAll
+    Entry& insertEntry(Shard& shard, const std::string& key, Waiters& evicted);
+    void evictIfNeeded(Shard& shard, Waiters& evicted);
+    static void resumeAll(const Waiters& waiters);
+    void claim(Entry& entry, Clock::time_point now) const;
+
+    // 缓存命中的时候把缓存的响应写到 response 里面，before 返回 kRespond，不再往后执行
+    static Action serve(const CachedResponse& cached, HttpResponse& response);
+
+private:
+    CacheConfig                         config_;
+    std::array<Shard, kShardCount>      shards_;
+};
+
+} // namespace middleware
+} // namespace http
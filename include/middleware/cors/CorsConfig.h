@@ -13,7 +13,7 @@ struct CorsConfig
     std::vector<std::string> allowedOrigins;
     std::vector<std::string> allowedMethods;
     std::vector<std::string> allowedHeaders;
-    bool allowCredentials = false;
+    bool allowCredentials = false;          // 为 true 的时候 allowedOrigins 必须是明确的列表，不能为空或者包含 "*"
     int maxAge = 3600;
 
     static CorsConfig defaultConfig()
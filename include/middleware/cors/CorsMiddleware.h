@@ -4,29 +4,33 @@
 #include "../../http/HttpRequest.h"
 #include "../../http/HttpResponse.h"
 #include "CorsConfig.h"
+#include "CorsPolicy.h"
 
 namespace http
 {
 namespace middleware
 {
     
+// 配置在构造的时候编译成 CorsPolicy，每个请求只需要查一次 origin、往响应里面放几个准备好的字符串
+// 允许所有 origin 并且不带凭证的时候返回 Access-Control-Allow-Origin: *，
+// 否则回显请求的 Origin，并且加上 Vary: Origin，避免缓存把给一个 origin 的响应返回给另一个 origin
 class CorsMiddleware : public Middleware
 {
 public:
     explicit CorsMiddleware(const CorsConfig& config = CorsConfig::defaultConfig());
 
-    void before(HttpRequest& request) override;
+    Action before(HttpRequest& request, HttpResponse& response) override;
     void after(HttpResponse& response) override;
-
-    std::string join(const std::vector<std::string>& strings, const std::string& delimiter);
+    void afterRequest(const HttpRequest& request, HttpResponse& response) override;
+    const char* name() const override { return "cors"; }
 
 private:
-    bool isOriginAllowed(const std::string& origin) const;
     void handlePreflightRequest(const HttpRequest& request, HttpResponse& response);
-    void addCorsHeaders(HttpResponse& response, const std::string& origin);
+    // 设置 Allow-Origin / Allow-Credentials / Vary，origin 不允许的时候返回 false
+    bool addOriginHeaders(const std::string& origin, HttpResponse& response);
 
 private:
-    CorsConfig config_;
+    CorsPolicy policy_;
 };
 
 } // namespace middleware
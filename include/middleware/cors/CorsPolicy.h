@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "CorsConfig.h"
+
+namespace http
+{
+namespace middleware
+{
+
+// CorsConfig 编译之后的结果，构造的时候把每个请求都要用到的东西准备好：
+//      Allow-Methods / Allow-Headers / Max-Age 这些响应头的值提前拼好
+//      精确的 origin 放到哈希表里面，忽略大小写
+//      https://*.example.com 这种通配的 origin 拆成前缀和后缀，匹配的时候只比较两端
+// 白名单为空或者包含 "*" 的时候允许所有 origin
+class CorsPolicy
+{
+public:
+    // 允许所有 origin 的同时 allowCredentials 为 true 的时候抛出 std::invalid_argument
+    explicit CorsPolicy(const CorsConfig& config);
+
+    bool allowAllOrigins() const { return allowAll_; }
+    bool allowCredentials() const { return allowCredentials_; }
+
+    // origin 是请求头里面的原始值
+    bool isOriginAllowed(const std::string& origin) const;
+
+    const std::string& allowMethods() const { return allowMethods_; }
+    const std::string& allowHeaders() const { return allowHeaders_; }
+    const std::string& maxAge() const { return maxAge_; }
+
+private:
+    static std::string toLower(const std::string& s);
+    static std::string join(const std::vector<std::string>& strings);
+
+private:
+    bool                                            allowAll_;
+    bool                                            allowCredentials_;
+    std::unordered_set<std::string>                 exactOrigins_;      // 小写
+    std::vector<std::pair<std::string, std::string>> wildcardOrigins_;  // * 前面的部分和后面的部分，小写
+    std::string                                     allowMethods_;
+    std::string                                     allowHeaders_;
+    std::string                                     maxAge_;
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+namespace http
+{
+namespace middleware
+{
+
+struct RateLimitConfig
+{
+    // 按什么区分客户端
+    enum KeyType
+    {
+        kClientIp,      // 对端 IP
+        kHeader,        // 某个请求头的值，例如 X-API-Key
+        kCookie,        // 某个 cookie 的值，例如 sessionId
+    };
+
+    KeyType keyType = kClientIp;
+    std::string keyName;                // kHeader / kCookie 时的请求头或 cookie 名字，取不到值的时候退回按 IP 限流
+
+    double ratePerSecond = 10.0;        // 令牌的生成速度，也就是长期的平均请求速率
+    double burst = 20.0;                // 桶的容量，允许的突发请求数
+    size_t maxClients = 100000;         // 同时记录的客户端数量上限，超过之后淘汰最久没有请求的客户端
+
+    static RateLimitConfig defaultConfig()
+    {
+        return RateLimitConfig();
+    }
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "RateLimitConfig.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace http
+{
+namespace middleware
+{
+
+// 令牌桶限流：每个客户端一个桶，请求来的时候按距离上次请求的时间补充令牌(不需要定时器)，
+// 有令牌就放行并且消耗一个，没有就直接返回 429，并且用 Retry-After 告诉客户端多久之后会有令牌
+//
+// 桶按客户端 key 的哈希分到多个分片里面，每个分片一把锁，锁里面只有一次哈希查找和几次浮点运算，
+// IO 线程之间基本不会互相等待；每个分片的客户端数量有上限，超过之后淘汰最久没有请求的客户端
+//
+// 要对不同的路径设置不同的限制，用 HttpServer::addMiddleware(prefix, ...) 给每个前缀添加一个实例
+class RateLimitMiddleware : public Middleware
+{
+public:
+    explicit RateLimitMiddleware(const RateLimitConfig& config = RateLimitConfig::defaultConfig());
+
+    Action before(HttpRequest& request, HttpResponse& response) override;
+    void after(HttpResponse& response) override;
+    const char* name() const override { return "rate_limit"; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket
+    {
+        double              tokens;
+        Clock::time_point   lastRefill;
+        std::list<std::string>::iterator lruIt;
+    };
+
+    struct Shard
+    {
+        std::mutex                              mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+        std::list<std::string>                  lru;        // 前面是最近请求过的客户端
+    };
+
+    static constexpr size_t kShardCount = 64;
+    static constexpr int64_t kWarnIntervalMs = 10000;
+
+    // 取不到配置的请求头或者 cookie 的时候退回到对端 IP
+    void makeKey(const HttpRequest& request, std::string& key) const;
+
+    // 返回 0 表示放行，否则返回客户端需要等待的秒数
+    int acquire(const std::string& key);
+
+    // 被拒绝的请求只计数，每 kWarnIntervalMs 最多打一条汇总的 WARN
+    void countRejected();
+
+private:
+    RateLimitConfig                     config_;
+    std::array<Shard, kShardCount>      shards_;
+    std::atomic<uint64_t>               rejected_{0};      // 上次汇总之后拒绝的请求数
+    std::atomic<int64_t>                lastWarnMs_{0};    // 上次汇总的时间，0 表示还没有汇总过
+};
+
+} // namespace middleware
+} // namespace http
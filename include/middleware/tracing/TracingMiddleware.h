@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../Middleware.h"
+#include "../../http/HttpRequest.h"
+#include "../../http/HttpResponse.h"
+#include "../../trace/Tracer.h"
+
+namespace http
+{
+namespace middleware
+{
+
+// 请求追踪的入口：构造的时候打开 Tracer(启动导出线程)，每个请求在 before 里面
+//      请求带了合法的 traceparent 就沿用上游的 trace id，按上游的采样标记决定是否采样，
+//      否则生成新的 trace id，按 sampleRatio 采样
+// 不采样的请求不再记录阶段，也不会导出；处理器可以用 request.trace()->traceparent() 往下游传
+//
+// 应该第一个添加，这样后面所有中间件的耗时都能记下来
+class TracingMiddleware : public Middleware
+{
+public:
+    explicit TracingMiddleware(const trace::TraceConfig& config = trace::TraceConfig());
+
+    Action before(HttpRequest& request, HttpResponse& response) override;
+    void after(HttpResponse& response) override;
+    const char* name() const override { return "tracing"; }
+};
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../http/HttpRequest.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http
+{
+namespace router
+{
+
+// 压缩前缀树(radix tree)，一次遍历完成 静态路径、:name 参数 和 末尾通配符 *name 的匹配
+//
+// 例如注册了下面几条路由：
+//      /users/new
+//      /users/:id
+//      /users/:id/posts
+//      /static/*filepath
+// 树的结构是这样的(公共前缀被压缩到同一个节点里面)：
+//      /
+//      ├── users/
+//      │   ├── new
+//      │   └── :id
+//      │       └── /posts
+//      └── static/
+//          └── *filepath
+//
+// 匹配优先级：静态 > 参数 > 通配符，前面的分支匹配失败会回溯到后面的分支，
+// 所以 /users/newbie 会匹配到 /users/:id 而不是失败
+//
+// 参数和通配符只能出现在一个路径段的开头(紧跟在 / 后面)，同一个位置的参数名必须一致
+//
+// 参数还可以写成 {name:类型} 的形式，匹配的时候用手写的扫描函数校验，不合法的 URL 在路由阶段就被拒绝：
+//      {id:int}            有符号 64 位整数，解析出来的值放在 Param::intValue
+//      {uuid:uuid}         8-4-4-4-12 的十六进制 UUID，解析出来的 16 个字节放在 Param::uuid
+//      {slug:[a-z0-9-]+}   字符集合，只支持 [...] 后面跟 +，集合里面可以写 a-z 这样的范围
+//      {name}              和 :name 一样，匹配任意非空的路径段
+// 同一个位置可以有多个不同类型的参数，带类型的按注册顺序先试，都不匹配再试不带类型的
+class RouteTree
+{
+public:
+    enum ParamType
+    {
+        kString, kInt, kUuid
+    };
+
+    struct Param
+    {
+        const std::string*  name;           // 参数名，指向树节点里面的字符串
+        std::string_view    text;           // 在请求路径中对应的片段
+        ParamType           type;
+        int64_t             intValue;       // type 是 kInt 的时候有效
+        HttpRequest::Uuid   uuid;           // type 是 kUuid 的时候有效
+    };
+
+    using Params = std::vector<Param>;
+
+    RouteTree();
+    ~RouteTree();
+
+    RouteTree(RouteTree&&) noexcept;
+    RouteTree& operator=(RouteTree&&) noexcept;
+
+    // 插入一条路由，value 是调用方自己的路由编号，literal 为 true 时 : * { 也当作普通字符
+    // 同一个位置同一种类型出现不同的参数名、类型写错了，或者通配符后面还有内容时抛出 std::invalid_argument
+    void insert(const std::string& pattern, int value, bool literal = false);
+
+    // 匹配成功返回 insert 时的 value，并把路径参数写到 params 里面；失败返回 -1
+    int match(std::string_view path, Params& params) const;
+
+private:
+    struct Node;
+    struct Constraint;
+
+    Node* insertStatic(Node* node, std::string_view text);
+    static Node* insertParam(Node* node, const std::string& name, Constraint constraint, const std::string& pattern);
+    static Constraint parseConstraint(const std::string& spec, const std::string& pattern);
+    static bool scan(const Constraint& constraint, std::string_view segment, Param& param);
+    static int matchNode(const Node* node, std::string_view path, Params& params);
+
+private:
+    std::unique_ptr<Node> root_;
+};
+
+}   // namespace router
+}   // namespace http
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "../../include/http/HttpRequest.h"
+#include "../../include/metrics/Metrics.h"
+#include "../../include/middleware/MiddlewareChain.h"
+#include "../../include/trace/Tracer.h"
 #include "RouterHandler.h"
+#include "RouteTree.h"
+#include "StaticRouteTable.h"
 
+#include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
-#include <regex>
 
 namespace http
 {
@@ -17,103 +24,186 @@ namespace router
 // 选择注册对象式的路由处理器还是注册回调函数式的处理器取决于处理器执行的复杂程度
 // 注册对象式的路由处理器（对象可以封装多个相关函数）
 // 上述逻辑都是一样的，只不过是存在方式不一样，如果是对象式的，就是把回调函数封装成了某种对象，比如 struct 或者 ptr
+//
+// 所有路由(静态的和动态的)都放在按请求方法划分的 radix tree 里面，一次遍历就能找到处理器，
+// 动态路由的参数按注册时候的名字设置，例如 /users/:id 匹配之后用 req.getPathParameters("id") 取，
+// 带类型的参数例如 /users/{id:int}，类型不对的 URL 匹配不上，解析好的值用 req.getPathParameters("id", intValue) 取
+//
+// 另外可以挂一张编译期路由表(StaticRouteTable)，route 的时候先查编译期路由表，查不到再查 radix tree，
+// 所以同一个 method + path 两边都注册了的时候，编译期路由表里面的优先
+//
+// 服务器运行的时候也可以增删路由(RCU)：
+//      路由表(radix tree + 处理器)构建好之后就不再修改，route() 只用 acquire 读一次指针，不加锁
+//      每次增删路由都在锁里面重新构建一张新表，用一次原子写发布出去
+//      旧表不能马上释放，因为 IO 线程可能正在用它，交给 Reclaimer 在所有 IO loop 都经过一次
+//      静止点(当前的事件处理完了)之后再释放，没有设置 Reclaimer 的时候(服务器还没启动)直接释放
+//
+// 中间件按路径前缀挂在 Router 上，构建路由表的时候就给每条路由算好它要经过的中间件链，
+// 请求匹配到路由之后只执行这条链；没有任何中间件的路由(健康检查、静态资源)完全不经过中间件
+// 前缀按路径段匹配：/api 匹配 /api 和 /api/users，不匹配 /apix；/ 匹配所有路径
+// 同一条链里面中间件的顺序就是注册的顺序，和前缀的长短无关
 class Router
 {
 public:
     // 两种回调定义格式
     using HandlerPtr = std::shared_ptr<RouterHandler>;
     using HandlerCallback = std::function<void(const HttpRequest &, HttpResponse*)>;
+    // 参数是释放旧路由表的函数，Reclaimer 要保证在所有读者都不再使用旧表之后调用它
+    using Reclaimer = std::function<void(std::function<void()>)>;
+    using ChainPtr = std::shared_ptr<const middleware::MiddlewareChain>;
 
-    struct RouteKey
-    {
-        HttpRequest::Method method;
-        std::string path;
+    Router();
+    ~Router();
 
-        bool operator == (const RouteKey& other) const{
-            return method == other.method && path == other.path;
-        }
-    };
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
 
-    // 为 RouteKey 定义哈希函数
-    struct RouteKeyHash
-    {
-        size_t operator()(const RouteKey& key) const{
-            size_t methodHash = std::hash<int>{} (static_cast<int> (key.method));
-            size_t pathHash   = std::hash<std::string>{} (key.path);
-            return methodHash * 31 + pathHash;
-        }
-    };  
-
-    // 注册路由处理器
+    // 注册路由处理器，path 按字面匹配
     void registerHandler(HttpRequest::Method method, const std::string& path, HandlerPtr handler);
 
-    // 注册回调函数形式的处理器
+    // 注册回调函数形式的处理器，path 按字面匹配
     void registerCallback(HttpRequest::Method method, const std::string& path, const HandlerCallback callback);
 
-    // 注册动态路由处理器
-    void addRegexHandler(HttpRequest::Method method, const std::string& path, HandlerPtr handler)
-    {
-        std::regex pathRegex = convertToRegex(path);
-        regexHandlers_.emplace_back(method, pathRegex, handler);
-    }
+    // 注册动态路由处理器，path 支持 /users/:id、/users/{id:int} 这种参数和 /static/*filepath 这种末尾通配符
+    void addPatternHandler(HttpRequest::Method method, const std::string& path, HandlerPtr handler);
 
     // 注册动态路由处理函数
-    void addRegexCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback )
+    void addPatternCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback);
+
+    // 删除一条路由，method 和 path 要和注册的时候一样，没有这条路由返回 false
+    bool removeRoute(HttpRequest::Method method, const std::string& path);
+
+    // 挂上编译期路由表，一个 Router 只有一张，再次调用会替换掉以前的
+    template <typename Table>
+    void setStaticRoutes()
     {
-        std::regex pathRegex = convertToRegex(path);
-        regexCallbacks_.emplace_back(method, pathRegex, callback);
+        StaticRoutes routes;
+        routes.dispatch = &Router::dispatchStatic<Table>;
+        for(size_t i = 0; i < Table::kRouteCount; ++i)
+        {
+            routes.paths.emplace_back(Table::kPaths[i]);
+            routes.routeIds.push_back(registerMetrics(Table::kMethods[i], routes.paths.back()));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        staticRoutes_ = std::move(routes);
+        publish(buildTable(specs_));
     }
 
-    bool route(const HttpRequest &req, HttpResponse* resp);
+    // 给 prefix 下面的所有路由(包括以后注册的)加上一个中间件
+    void addMiddleware(const std::string& prefix, std::shared_ptr<middleware::Middleware> middleware);
+
+    // 服务器启动之后由 HttpServer 设置
+    void setReclaimer(Reclaimer reclaimer);
+
+    // 匹配成功的时候会把路径参数设置到 req 上，然后经过这条路由的中间件链交给处理器
+    // 没有匹配的路由时什么都不做，返回 false
+    bool route(HttpRequest &req, HttpResponse* resp);
+
+    // 没有匹配到路由的请求(404、CORS 预检)按路径前缀找中间件链，没有中间件时返回空
+    // 返回的指针只在当前这次事件处理里面有效
+    const middleware::MiddlewareChain* chainFor(const std::string& path) const;
 
 private:
-    std::regex convertToRegex(const std::string& pathPattern)
+    // 每条路由在指标系统里面对应一个 id，用于记录每条路由的处理延迟
+    static int registerMetrics(HttpRequest::Method method, const std::string& path)
     {
-        // 将路径模式转换为正则表达式，支持匹配任意路径参数
-        std::string regexPattern = "^" + std::regex_replace(pathPattern, std::regex(R"(/:([^/]+))"), R"(/([^/]+))") + "$";
-        return std::regex(regexPattern);
-    }
-    
-    // 提取路径参数
-    void extractPathParameters(const std::smatch &match, HttpRequest & request)
-    {
-        // 我们这里假设 第一个match的就是整个的路径，参数从index=1 开始
-        for(size_t i = 1; i<match.size(); ++i)
-        {
-            request.setPathParameters("param" + std::to_string(i), match[i].str());
-        }
+        return metrics::MetricsRegistry::getInstance().registerRoute(HttpRequest::methodString(method), path);
     }
 
+    void addRoute(HttpRequest::Method method, const std::string& path, HandlerPtr handler,
+                  HandlerCallback callback, bool literal);
+
 private:
-    // 这俩是为了正则匹配服务的，所以要封装相应的正则
-    struct RouteCallbackObj
+    // 处理器和回调只会有一个不为空
+    struct RouteEntry
     {
-        HttpRequest::Method method_;
-        std::regex pathRegex_;
+        HandlerPtr      handler_;
         HandlerCallback callback_;
-        RouteCallbackObj(HttpRequest::Method method, std::regex pathRegex, const HandlerCallback & callback)
-            : method_(method), pathRegex_(pathRegex), callback_(callback)
-        {}
+        int             routeId_;
+        ChainPtr        chain_;         // 构建路由表的时候算好，没有中间件时为空
+        std::string     pattern_;       // 注册时的路径，请求追踪里面用
     };
 
-    struct RouteHandlerObj
+    // 注册的原始信息，每次构建新表都从这里开始
+    struct RouteSpec
     {
-        HttpRequest::Method method_;
-        std::regex pathRegex_;
-        HandlerPtr handler_;
-        RouteHandlerObj(HttpRequest::Method method, std::regex pathRegex, HandlerPtr handler)
-            : method_(method), pathRegex_(pathRegex), handler_(handler)
-        {}
+        HttpRequest::Method method;
+        std::string         path;
+        bool                literal;
+        RouteEntry          entry;
+    };
+
+    // 编译期路由表的入口，dispatch 指向按表的类型实例化的 dispatchStatic
+    struct StaticRoutes
+    {
+        bool (*dispatch)(const StaticRoutes&, HttpRequest&, HttpResponse*, trace::ScopedPhase&) = nullptr;
+        std::vector<std::string> paths;
+        std::vector<int> routeIds;
+        std::vector<ChainPtr> chains;
+    };
+
+    // 查找和调用处理函数在同一个函数里面，Table 是模板参数，处理函数的调用是直接调用，可以被内联，
+    // 一个请求只有 route() 调用 dispatch 这一次间接调用；没有匹配到返回 false
+    template <typename Table>
+    static bool dispatchStatic(const StaticRoutes& routes, HttpRequest& req, HttpResponse* resp,
+                               trace::ScopedPhase& match)
+    {
+        int index = Table::find(req.method(), req.path());
+        if(index < 0)
+        {
+            return false;
+        }
+        match.finish();
+
+        trace::RequestTrace* trace = req.trace();
+        if(trace)
+        {
+            trace->route = routes.paths[index];
+        }
+        const middleware::MiddlewareChain* chain = routes.chains[index].get();
+        size_t entered = 0;
+        if(!chain || chain->processBefore(req, *resp, entered))
+        {
+            metrics::ScopedRouteTimer timer(routes.routeIds[index]);
+            trace::ScopedPhase phase(trace, "handler");
+            Table::invoke(index, req, resp);
+        }
+        if(chain)
+        {
+            chain->processAfter(req, *resp, entered);
+        }
+        return true;
+    }
+
+    static constexpr int kMethodCount = HttpRequest::kOptions + 1;
+
+    // 发布之后只读的路由表
+    struct RouteTable
+    {
+        std::array<RouteTree, kMethodCount>     trees_;     // 每个请求方法一棵树
+        std::vector<RouteEntry>                 routes_;    // 树里面存的是这里的下标
+        StaticRoutes                            staticRoutes_;
+        // 每个出现过的前缀对应的中间件链，长的前缀在前面
+        // 一个路径的中间件链就是它匹配到的最长前缀的链，因为比它短的前缀也一定是这个前缀的前缀
+        std::vector<std::pair<std::string, ChainPtr>> prefixChains_;
     };
 
-    // 我们这里定义了哈希表，并且定义 key 为 RouteKey， 我们这里一定要对 RouteKey 做 == 重载
-    // 同时，我们要定义哈希规则, 也就是hash函数
-    std::unordered_map<RouteKey, HandlerPtr, RouteKeyHash>              handlers_;           // 精确匹配
-    std::unordered_map<RouteKey, HandlerCallback, RouteKeyHash>         callbacks_;     // 精确匹配
+    static bool prefixMatches(const std::string& prefix, const std::string& path);
+    static ChainPtr findChain(const RouteTable& table, const std::string& path);
 
-    std::vector<RouteHandlerObj>                                        regexHandlers_;     // 正则匹配
-    std::vector<RouteCallbackObj>                                       regexCallbacks_;    // 正则匹配    
+    // 下面两个函数要在 mutex_ 里面调用
+    std::unique_ptr<RouteTable> buildTable(const std::vector<RouteSpec>& specs) const;
+    void publish(std::unique_ptr<RouteTable> table);
+
+private:
+    std::atomic<const RouteTable*>  table_;         // 当前的路由表，请求路径上只读这一个指针
+    std::mutex                      mutex_;         // 写者之间互斥，保护下面的成员
+    std::vector<RouteSpec>          specs_;
+    StaticRoutes                    staticRoutes_;
+    std::vector<std::pair<std::string, std::shared_ptr<middleware::Middleware>>> middlewares_;  // 前缀 -> 中间件，按注册顺序
+    Reclaimer                       reclaimer_;
 };
 
 }   // namespace router
-}   // namespace http
\ No newline at end of file
+}   // namespace http
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "../../include/http/HttpRequest.h"
+#include "../../include/http/HttpResponse.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace http
+{
+namespace router
+{
+
+// 编译期路由表：路由在编译的时候就已经确定，完美哈希也在编译期算好
+//
+// 每条路由是一个类型，提供 method、path 和静态函数 handle，一般用 StaticRoute 派生：
+//      void handleStatus(const HttpRequest& req, HttpResponse* resp);
+//
+//      struct StatusRoute : StaticRoute<HttpRequest::kGet, handleStatus>
+//      {
+//          static constexpr std::string_view path = "/api/status";
+//      };
+//
+//      using ApiRoutes = StaticRouteTable<StatusRoute, TimeRoute, EchoRoute>;
+//      server.setStaticRoutes<ApiRoutes>();
+//
+// 查找的时候对 (method, path) 只哈希一次，用两级完美哈希(hash and displace)定位到唯一的槽位，
+// 再比较一次字符串确认；处理函数是模板参数，调用是直接调用，可以被内联，
+// 不经过 std::function 或者虚函数；Router 为每张表实例化一个分发函数，查找和调用都在里面
+//
+// 重复的路由和找不到完美哈希都是编译错误(static_assert)
+//
+// 只支持按字面匹配的路径，带参数和通配符的路由仍然注册到 Router 的 radix tree 里面
+template <HttpRequest::Method M, void (*Handler)(const HttpRequest&, HttpResponse*)>
+struct StaticRoute
+{
+    static constexpr HttpRequest::Method method = M;
+
+    static void handle(const HttpRequest& req, HttpResponse* resp)
+    {
+        Handler(req, resp);
+    }
+};
+
+namespace detail
+{
+
+// FNV-1a，编译期和运行期用的是同一个函数，保证结果一致
+constexpr uint32_t hashRoute(int method, std::string_view path)
+{
+    uint32_t h = 2166136261u;
+    h = (h ^ static_cast<uint32_t>(method)) * 16777619u;
+    for(char c : path)
+    {
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return h;
+}
+
+// 第二级哈希：在第一级哈希值上混入每个桶的种子，不需要再扫描一遍字符串
+constexpr uint32_t mixSeed(uint32_t h, uint32_t seed)
+{
+    h ^= seed * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+constexpr size_t nextPowerOfTwo(size_t n)
+{
+    size_t p = 1;
+    while(p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+}   // namespace detail
+
+template <typename... Routes>
+class StaticRouteTable
+{
+public:
+    static constexpr size_t kRouteCount = sizeof...(Routes);
+
+    static_assert(kRouteCount > 0, "StaticRouteTable needs at least one route");
+
+    static constexpr std::array<HttpRequest::Method, kRouteCount> kMethods = { Routes::method... };
+    static constexpr std::array<std::string_view, kRouteCount> kPaths = { Routes::path... };
+
+    // 找到返回路由的下标，找不到返回 -1
+    static int find(HttpRequest::Method method, std::string_view path)
+    {
+        uint32_t h = detail::hashRoute(method, path);
+        uint32_t seed = kLayout.seeds[h & (kBucketCount - 1)];
+        int index = kLayout.slots[detail::mixSeed(h, seed) & (kSlotCount - 1)];
+        if(index < 0 || kMethods[index] != method || kPaths[index] != path)
+        {
+            return -1;
+        }
+        return index;
+    }
+
+    // 按下标调用处理函数，展开之后就是一串对常量的比较，编译器一般会生成跳转表
+    static void invoke(int index, const HttpRequest& req, HttpResponse* resp)
+    {
+        invokeAt(index, req, resp, std::index_sequence_for<Routes...>{});
+    }
+
+private:
+    // 槽位数取 2 倍路由数向上到 2 的幂，桶数大约是路由数的一半，
+    // 负载不高，每个桶一般试几个种子就能放下
+    static constexpr size_t kSlotCount = detail::nextPowerOfTwo(kRouteCount * 2);
+    static constexpr size_t kBucketCount = detail::nextPowerOfTwo((kRouteCount + 1) / 2);
+    // 每个桶最多试这么多种子；编译期求值有步数限制(例如 clang 的 -fconstexpr-steps)，
+    // 不能无限制地搜索，找不到的时候由下面的 static_assert 报错，而不是超出步数限制
+    static constexpr uint32_t kMaxSeed = 1024;
+
+    struct Layout
+    {
+        std::array<uint32_t, kBucketCount>  seeds{};    // 每个桶的第二级哈希种子
+        std::array<int, kSlotCount>         slots{};    // 槽位里面存路由下标，-1 表示空
+        bool                                ok = false; // 每个桶都找到了种子
+    };
+
+    static constexpr bool unique()
+    {
+        for(size_t i = 0; i < kRouteCount; ++i)
+        {
+            for(size_t j = i + 1; j < kRouteCount; ++j)
+            {
+                if(kMethods[i] == kMethods[j] && kPaths[i] == kPaths[j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static constexpr Layout buildLayout()
+    {
+        Layout layout{};
+        // 重复的路由哈希值相同，任何种子都放不下，不用去搜索
+        if(!kUnique)
+        {
+            return layout;
+        }
+
+        std::array<uint32_t, kRouteCount> hashes{};
+        std::array<size_t, kBucketCount> bucketSizes{};
+        for(size_t i = 0; i < kRouteCount; ++i)
+        {
+            hashes[i] = detail::hashRoute(kMethods[i], kPaths[i]);
+            ++bucketSizes[hashes[i] & (kBucketCount - 1)];
+        }
+
+        for(int& slot : layout.slots)
+        {
+            slot = -1;
+        }
+
+        // 先放元素多的桶，后面的小桶更容易找到空位
+        for(size_t size = kRouteCount; size > 0; --size)
+        {
+            for(size_t bucket = 0; bucket < kBucketCount; ++bucket)
+            {
+                if(bucketSizes[bucket] == size && !placeBucket(layout, hashes, bucket))
+                {
+                    return layout;
+                }
+            }
+        }
+        layout.ok = true;
+        return layout;
+    }
+
+    static constexpr bool placeBucket(Layout& layout, const std::array<uint32_t, kRouteCount>& hashes, size_t bucket)
+    {
+        for(uint32_t seed = 0; seed < kMaxSeed; ++seed)
+        {
+            std::array<size_t, kRouteCount> taken{};
+            size_t count = 0;
+            bool ok = true;
+            for(size_t i = 0; i < kRouteCount && ok; ++i)
+            {
+                if((hashes[i] & (kBucketCount - 1)) != bucket)
+                {
+                    continue;
+                }
+                size_t slot = detail::mixSeed(hashes[i], seed) & (kSlotCount - 1);
+                if(layout.slots[slot] >= 0)
+                {
+                    ok = false;
+                }
+                for(size_t k = 0; k < count && ok; ++k)
+                {
+                    if(taken[k] == slot)
+                    {
+                        ok = false;
+                    }
+                }
+                taken[count++] = slot;
+            }
+
+            if(ok)
+            {
+                count = 0;
+                for(size_t i = 0; i < kRouteCount; ++i)
+                {
+                    if((hashes[i] & (kBucketCount - 1)) == bucket)
+                    {
+                        layout.slots[taken[count++]] = static_cast<int>(i);
+                    }
+                }
+                layout.seeds[bucket] = seed;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <size_t... I>
+    static void invokeAt(int index, const HttpRequest& req, HttpResponse* resp, std::index_sequence<I...>)
+    {
+        (void)((index == static_cast<int>(I) ? (Routes::handle(req, resp), true) : false) || ...);
+    }
+
+    static constexpr bool kUnique = unique();
+    static constexpr Layout kLayout = buildLayout();
+
+    static_assert(kUnique, "StaticRouteTable: the same (method, path) is registered twice");
+    static_assert(!kUnique || kLayout.ok,
+                  "StaticRouteTable: no perfect hash seed found within kMaxSeed tries, add or rename a route or raise kMaxSeed");
+};
+
+}   // namespace router
+}   // namespace http
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Session.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace http
+{
+namespace session
+{
+
+struct CookieSessionConfig
+{
+    // 第一个密钥用来签发新的 cookie，后面的只用来验证之前签发的 cookie
+    // 轮换密钥的时候把新密钥加到最前面，等旧 cookie 都过期(maxAge)之后再把旧密钥去掉
+    std::vector<std::string> secrets;
+
+    bool        encrypt = false;        // true 的时候用 AES-256-GCM 加密，客户端看不到会话内容
+    std::string cookieName = "session";
+    int         maxAge = 3600;          // 会话有效期(秒)，过了一半之后的请求会重新签发 cookie 延长有效期
+    size_t      maxCookieSize = 4000;   // 浏览器一般限制一个 cookie 4KB，超过的会话不会写回
+};
+
+// 无状态会话：整个会话(id、过期时间、数据)放在 cookie 里面，服务器上不保存任何东西，
+// 任何节点、任何线程都可以直接验证，不需要查存储，也不需要加锁
+//
+// cookie 的格式：
+//      签名：s1.<base64url(JSON)>.<base64url(HMAC-SHA256)>，签名覆盖前面的全部内容
+//      加密：e1.<base64url(IV || 密文 || GCM tag)>，GCM 的 tag 同时保证内容没有被改过，不再另外签名
+// JSON 是 {"i": 会话 id, "e": 过期时间(Unix 毫秒), "d": {数据}}
+//
+// 每个密钥派生出签名和加密两个子密钥，构造的时候算好；验证的时候按顺序尝试每个密钥
+class CookieSessionCodec
+{
+public:
+    // secrets 为空的时候抛出 std::invalid_argument
+    explicit CookieSessionCodec(const CookieSessionConfig& config);
+    ~CookieSessionCodec();
+
+    CookieSessionCodec(const CookieSessionCodec&) = delete;
+    CookieSessionCodec& operator=(const CookieSessionCodec&) = delete;
+
+    const CookieSessionConfig& config() const { return config_; }
+
+    // 编码失败(例如数据太大)返回空字符串
+    std::string encode(const Session& session) const;
+
+    // 验证失败或者已经过期返回空；rotated 表示是用旧密钥签发的，应该用新密钥重新签发
+    std::shared_ptr<Session> decode(const std::string& value, bool& rotated) const;
+
+private:
+    struct Key
+    {
+        std::string macKey;     // HMAC-SHA256 的密钥
+        std::string encKey;     // AES-256-GCM 的密钥，32 字节
+    };
+
+    std::string sign(const std::string& payload) const;
+    std::string seal(const std::string& payload) const;
+    bool verify(const std::string& value, std::string& payload, bool& rotated) const;
+    bool open(const std::string& value, std::string& payload, bool& rotated) const;
+    std::shared_ptr<Session> parse(const std::string& payload) const;
+
+    static std::string hmacSha256(const std::string& key, const char* data, size_t len);
+
+private:
+    CookieSessionConfig     config_;
+    std::vector<Key>        keys_;      // 和 config_.secrets 一一对应
+    EVP_CIPHER*             cipher_;    // 构造的时候取一次，不在每个请求上查找算法
+};
+
+} // namespace session
+} // namespace http
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "SessionStorage.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace http
+{
+namespace session
+{
+
+struct MysqlSessionConfig
+{
+    std::string table = "sessions";     // 表名直接拼进 SQL，只能是配置写死的值
+    int    flushIntervalMs = 50;        // 写操作攒多久写一次数据库
+    size_t batchSize = 200;             // 一条 INSERT / DELETE 最多带多少个会话，攒够了立刻写
+    size_t cacheEntries = 10000;        // 进程内缓存的会话数量上限
+    int    cacheTtlMs = 5000;           // 缓存的会话超过这个时间重新从数据库读(其它进程可能改过)，0 表示一直用缓存
+    int    missCacheMs = 1000;          // 数据库里面查不到(或者查询失败)的会话 id 这段时间里面不再查，0 表示不缓存
+    int    purgeIntervalMs = 60000;     // 多久删除一次数据库里面过期的会话
+    size_t purgeBatch = 1000;           // 每次最多删除多少行
+};
+
+// 会话存在 MySQL 里面，进程重启之后会话还在，多个进程可以共享
+// 使用 db::DbConnectionPool 的连接，需要先调用 MysqlUtil::init 初始化连接池
+//
+// 表结构(data 是会话数据的 JSON，expires_at 是过期时间，Unix 毫秒)：
+//      CREATE TABLE sessions (
+//          id          VARCHAR(64) NOT NULL PRIMARY KEY,
+//          data        MEDIUMTEXT  NOT NULL,
+//          expires_at  BIGINT      NOT NULL,
+//          KEY idx_expires_at (expires_at)
+//      ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
+//
+// 请求不会直接访问数据库：
+//      写(save / flush / remove)只是把会话放进待写队列，同一个会话多次写只保留最后一次，
+//      后台线程每 flushIntervalMs 把队列里面的会话合并成多行的 INSERT ... ON DUPLICATE KEY UPDATE
+//      和 DELETE ... WHERE id IN (...)，写的是写入时会话的最新数据
+//      读(load)先查进程内缓存和还没有写完的队列，都没有才查一次数据库，查到之后放进缓存，
+//      查不到的 id 也记下来 missCacheMs，带着过期 cookie 的并发请求和数据库不可用的时候不会每个请求都查一次
+class MysqlSessionStorage : public SessionStorage
+{
+public:
+    explicit MysqlSessionStorage(const MysqlSessionConfig& config = MysqlSessionConfig());
+    // 把队列里面剩下的写完再返回
+    ~MysqlSessionStorage();
+
+    void save(std::shared_ptr<Session> session) override;
+    std::shared_ptr<Session> load(const std::string& sessionId) override;
+    void remove(const std::string& sessionId) override;
+    void flush(std::shared_ptr<Session> session, const SessionChanges& changes) override;
+    // 只清理进程内缓存，数据库里面过期的行由后台线程删除
+    void cleanExpired() override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct CacheEntry
+    {
+        std::shared_ptr<Session>            session;
+        Clock::time_point                   loadedAt;
+        std::list<std::string>::iterator    lruIt;
+    };
+
+    struct alignas(64) CacheShard
+    {
+        std::mutex                                      mutex;
+        std::unordered_map<std::string, CacheEntry>     entries;
+        std::list<std::string>                          lru;    // 前面是最近访问的
+        std::unordered_map<std::string, Clock::time_point> misses; // 查不到的会话 id -> 这个时间之前不再查数据库
+    };
+
+    // 会话 id -> 要写的会话，为空表示删除
+    using WriteMap = std::unordered_map<std::string, std::shared_ptr<Session>>;
+
+    static constexpr size_t kShardCount = 16;
+
+    CacheShard& shardFor(const std::string& sessionId);
+    void cachePut(const std::shared_ptr<Session>& session);
+    void cacheErase(const std::string& sessionId);
+    void cacheMiss(const std::string& sessionId);
+
+    void enqueue(const std::string& sessionId, std::shared_ptr<Session> session);
+    // 没有写完的写操作里面找这个会话，找到了返回 true，被删除的会话 session 为空
+    bool findQueued(const std::string& sessionId, std::shared_ptr<Session>& session);
+    std::shared_ptr<Session> loadFromDb(const std::string& sessionId);
+
+    void writeLoop();
+    // 写一批，返回写失败的，由 writeLoop 放回队列
+    WriteMap writeBatch(const WriteMap& batch);
+    void upsert(const std::vector<std::shared_ptr<Session>>& sessions);
+    void erase(const std::vector<std::string>& sessionIds);
+    void purgeExpired();
+
+    static int64_t nowMillis();
+
+private:
+    MysqlSessionConfig                      config_;
+    std::string                             upsertPrefix_;
+    std::string                             upsertSuffix_;
+    std::string                             selectSql_;
+    std::array<CacheShard, kShardCount>     cache_;
+
+    std::mutex                              mutex_;     // 保护下面几个成员
+    std::condition_variable                 cond_;
+    WriteMap                                queued_;    // 等待写的
+    WriteMap                                writing_;   // 后台线程正在写的，写完之前 load 也要看这里
+    bool                                    running_;
+    std::thread                             thread_;
+};
+
+} // namespace session
+} // namespace http
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "SessionStorage.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <muduo/net/Channel.h>
+#include <muduo/net/EventLoop.h>
+
+namespace http
+{
+namespace session
+{
+
+struct RedisSessionConfig
+{
+    std::string host = "127.0.0.1";
+    uint16_t    port = 6379;
+    std::string password;                   // 不为空的时候连接之后先 AUTH
+    int         database = 0;               // 不为 0 的时候连接之后 SELECT
+    std::string keyPrefix = "session:";     // 会话在 Redis 里面的 key 是 前缀 + 会话 id
+    int         timeoutMs = 200;            // 连接和等待 load 结果的超时时间
+    int         reconnectMinMs = 100;       // 断开之后第一次重连前等待的时间，之后每次失败翻倍
+    int         reconnectMaxMs = 5000;      // 重连等待时间的上限
+};
+
+// 会话存在 Redis(或者兼容 RESP 协议的服务器)里面，多个 HttpServer 进程可以共享会话
+//
+// 每个会话是一个 hash：用户数据一个 key 一个字段，再加上一个 __expires 字段记录过期时间(毫秒)，
+// 同时用 PEXPIREAT 设置服务器端的过期时间，过期的会话由 Redis 自己删除，cleanExpired 不需要做任何事
+//
+// 每个 IO 线程(每个 EventLoop)一条自己的连接，不需要加锁：
+//      写(save / flush / remove)只是把命令追加到发送缓冲区然后非阻塞地发出去，不等回复，
+//      回复由注册在 EventLoop 上的 Channel 在后面读掉，多个请求的写命令在连接上是流水线的
+//      读(load)的接口是同步的，发出 HGETALL 之后在这条连接上等它的回复(前面的写命令的回复按顺序跳过)，
+//      最多等 timeoutMs，超时就断开连接当作会话不存在；一个请求只有一次 load，也就是一个往返
+//
+// Redis 不可用的时候 IO 线程不能被卡住：
+//      地址在构造的时候解析一次，连接是非阻塞的，AUTH / SELECT 和后面的命令一起流水线发出去
+//      没有连上(包括正在连接)的时候命令直接丢掉，load 直接返回空，都不会在请求里面等待连接
+//      断开之后由 EventLoop 的定时器按退避时间重连(没有 EventLoop 的线程在下次使用的时候检查)
+class RedisSessionStorage : public SessionStorage
+{
+public:
+    explicit RedisSessionStorage(const RedisSessionConfig& config = RedisSessionConfig());
+    ~RedisSessionStorage();
+
+    void save(std::shared_ptr<Session> session) override;
+    std::shared_ptr<Session> load(const std::string& sessionId) override;
+    void remove(const std::string& sessionId) override;
+    void flush(std::shared_ptr<Session> session, const SessionChanges& changes) override;
+
+private:
+    // RESP 的回复，HGETALL 的结果是一个数组
+    struct Reply
+    {
+        enum Type { kString, kError, kInteger, kNil, kArray };
+
+        Type                type = kNil;
+        std::string         str;
+        int64_t             integer = 0;
+        std::vector<Reply>  elements;
+    };
+
+    // 构造的时候解析好的服务器地址，解析失败的时候 length 为 0
+    struct Endpoint
+    {
+        struct sockaddr_storage address;
+        socklen_t               length = 0;
+    };
+
+    // 一个线程一条连接，只在所属的线程上使用
+    class Connection : public std::enable_shared_from_this<Connection>
+    {
+    public:
+        Connection(const RedisSessionConfig& config, const Endpoint& endpoint, muduo::net::EventLoop* loop);
+        ~Connection();
+
+        // 非阻塞地开始连接，已经在连接或者已经连上的时候什么也不做
+        void connect();
+
+        // 追加一条命令，不等回复；没有连上的时候直接丢掉
+        void send(const std::vector<std::string>& args);
+        // 追加一条命令，然后等这条命令的回复；没有连上、失败或者超时返回 false
+        bool call(const std::vector<std::string>& args, Reply& reply);
+
+    private:
+        enum State { kDisconnected, kConnecting, kConnected };
+
+        // 没有连上的时候返回 false；没有 EventLoop 的线程在这里推进连接和重连
+        bool ready();
+        void finishConnect();
+        void onConnected();
+        // 出错断开，按退避时间安排重连；error 是相关的 errno，没有的时候为 0
+        void fail(const char* what, int error = 0);
+        void close();
+        void appendCommand(const std::vector<std::string>& args);
+        bool writeSome();           // 尽量把发送缓冲区写出去，出错返回 false
+        bool readSome();            // 把 socket 里面可读的数据读进接收缓冲区，对端关闭或者出错返回 false
+        bool nextReply(Reply& reply, bool& complete);   // 从接收缓冲区解析一个回复
+        bool checkReply(const Reply& reply);            // 检查一个不需要结果的回复，AUTH / SELECT 失败返回 false
+        void drainReplies();        // 处理已经收到的回复，写命令的回复只检查错误
+
+        void handleRead();
+        void handleWrite();
+        void handleError();
+
+    private:
+        const RedisSessionConfig&                   config_;
+        const Endpoint&                             endpoint_;
+        muduo::net::EventLoop*                      loop_;      // 当前线程没有 EventLoop 的时候为空
+        std::thread::id                             owner_;     // 创建连接的线程
+        State                                       state_;
+        int                                         fd_;
+        int                                         backoffMs_;         // 下一次重连前等待的时间
+        std::chrono::steady_clock::time_point       nextAttempt_;       // 没有 EventLoop 的时候，这个时间之后才重连
+        size_t                                      handshake_;         // 还没有收到回复的 AUTH / SELECT 数量
+        size_t                                      dropped_;           // 断开期间丢掉的命令数量
+        std::unique_ptr<muduo::net::Channel>        channel_;
+        std::string                                 output_;
+        std::string                                 input_;
+        size_t                                      inputPos_;  // input_ 里面已经解析过的位置
+        size_t                                      pending_;   // 已经发出去还没有读到回复的命令数
+    };
+
+    Connection& localConnection();
+    std::string keyFor(const std::string& sessionId) const;
+    static std::string millisString(Session::Clock::time_point time);
+
+    // 整个会话重写：MULTI, DEL, HSET 全部字段, PEXPIREAT, EXEC
+    void writeAll(const std::shared_ptr<Session>& session);
+
+private:
+    RedisSessionConfig                                          config_;
+    Endpoint                                                    endpoint_;
+    uint64_t                                                    id_;    // 区分线程局部缓存里面不同的存储实例
+    std::mutex                                                  mutex_;
+    std::unordered_map<std::thread::id, std::shared_ptr<Connection>> connections_;
+};
+
+} // namespace session
+} // namespace http
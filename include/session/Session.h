@@ -3,7 +3,11 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <chrono>
+#include <unordered_set>
+#include <vector>
 
 namespace http
 {
@@ -13,9 +17,28 @@ namespace session
 
 class SessionManager;
 
+// 一次请求里面会话的改动，请求结束的时候由 SessionManager 合并成一次写回存储
+struct SessionChanges
+{
+    bool created = false;                                   // 新建的会话，存储里面还没有
+    bool touched = false;                                   // 过期时间刷新过
+    std::unordered_map<std::string, std::string> updated;   // 改过的 key 和现在的值
+    std::vector<std::string> removed;                       // 删除的 key
+
+    bool empty() const
+    { return !created && !touched && updated.empty() && removed.empty(); }
+
+    bool dataChanged() const
+    { return created || !updated.empty() || !removed.empty(); }
+};
+
+// 同一个会话可能被不同 IO 线程上的请求同时使用(同一个浏览器的并发请求)，
+// 所以数据用一把会话自己的锁保护，过期时间和管理器指针是原子的
 class Session : public std::enable_shared_from_this<Session>
 {
 public:
+    using Clock = std::chrono::system_clock;
+
     Session(const std::string& sessionId, SessionManager* SessionManager, int maxAge = 3600);  // 默认一个小时过期
 
     const std::string& getId() const
@@ -24,24 +47,43 @@ public:
     bool isExpired() const;
     void refresh(); // 刷新过期时间
 
+    std::chrono::system_clock::time_point expiryTime() const
+    { return Clock::time_point(Clock::duration(expiryTime_.load(std::memory_order_relaxed))); }
+
+    // 大概占用的内存(id 加上所有的 key 和 value)，存储按这个限制总的内存
+    size_t approximateSize() const;
+
     void setManager(SessionManager* sessionManager)
-    { sessionManager_ = sessionManager; }
+    { sessionManager_.store(sessionManager, std::memory_order_release); }
 
     SessionManager* getManager() const
-    { return sessionManager_; }
+    { return sessionManager_.load(std::memory_order_acquire); }
 
-    // 数据存取
+    // 数据存取，修改只改内存里面的对象并且记下改了哪些 key，不会立刻写存储
     void setValue(const std::string& key, const std::string& value);
     std::string getValue(const std::string& key) const;
     void remove(const std::string& key);
     void clear();
 
+    // 取出上次取出之后的改动，并且清空改动记录
+    SessionChanges takeChanges();
+
+    // 存储加载会话的时候用：用存储里面的数据和过期时间替换当前内容，不算改动
+    void restore(std::unordered_map<std::string, std::string> data, Clock::time_point expiry);
+
+    // 当前所有数据的副本，存储整个保存会话的时候用
+    std::unordered_map<std::string, std::string> snapshot() const;
+
 private:
     std::string                                   sessionId_;
+    mutable std::mutex                            mutex_;       // 保护 data_, dirtyKeys_, created_
     std::unordered_map<std::string, std::string>  data_;        
-    std::chrono::system_clock::time_point         expiryTime_;
+    std::unordered_set<std::string>               dirtyKeys_;   // 改过或者删除的 key
+    bool                                          created_;     // 还没有写过存储
+    std::atomic<bool>                             touched_;     // 过期时间刷新之后还没有写过存储
+    std::atomic<Clock::rep>                       expiryTime_;  // system_clock 的 tick
     int                                           maxAge_;  // 过期时间(秒)
-    SessionManager*                               sessionManager_;
+    std::atomic<SessionManager*>                  sessionManager_;
 };
 
 }   // namespace session
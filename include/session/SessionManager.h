@@ -1,10 +1,11 @@
 #pragma once
 
+#include "CookieSessionCodec.h"
 #include "SessionStorage.h"
 #include "../../include/http/HttpRequest.h"
 #include "../../include/http/HttpResponse.h"
 #include <memory>
-#include <random>
+#include <mutex>
 
 namespace http
 {
@@ -15,29 +16,53 @@ class SessionManager
 {
 public:
     explicit SessionManager(std::unique_ptr<SessionStorage> storage);
+    // 无状态模式：会话整个放在 cookie 里面，不使用存储，见 CookieSessionCodec
+    explicit SessionManager(const CookieSessionConfig& config);
 
     // 从请求中获取或创建会话
+    // 改动在请求结束的时候由 HttpServer 写回，只有 setSessionManager 装上去的那个管理器会写回，
+    // 其它管理器拿到的会话在请求结束的时候丢掉
     std::shared_ptr<Session> getSession(const HttpRequest& req, HttpResponse* resp);
 
     // 销毁会话
+    // 无状态模式下服务器上没有可以删除的东西，只能让这次请求的响应清掉 cookie，
+    // 所以要在同一个请求里面先 getSession 再销毁
     void destorySession(const std::string& sessionId);
 
-    // 清理过期会话
+    // 清理过期会话，HttpServer 在 mainLoop 上每 kCleanIntervalSeconds 秒调用一次
     void cleanExpiredSessions();
 
-    // 更新会话
+    static constexpr double kCleanIntervalSeconds = 1.0;
+
+    // 立刻把整个会话写到存储里面，一般不需要调用，请求结束的时候会自动写回
+    // 无状态模式下没有存储，什么也不做，改动在请求结束的时候写到 cookie 里面
     void updateSession(std::shared_ptr<Session> session)
     {
-        storage_->save(session);
+        if(storage_)
+        {
+            session->takeChanges();
+            storage_->save(session);
+        }
     }
+
+    // 把当前线程这次请求里面 getSession 拿到的会话的改动写回存储，每个会话一次
+    // HttpServer 在处理器执行完、发送响应之前调用
+    void flushSessions();
+    // HttpServer 没有装会话管理器的时候，请求结束时清掉这次请求记下的会话
+    static void discardPendingSessions();
 private:
-    std::string generateSessionId();
+    // 128 位随机数的十六进制，32 个字符；随机数来自每个线程自己的缓冲区，不需要加锁
+    static std::string generateSessionId();
     std::string getSessionIdFromCookie(const HttpRequest& req);
     void setSessionCookie(const std::string& sessionId, HttpResponse* resp);
 
+    std::shared_ptr<Session> loadFromCookie(const HttpRequest& req);
+    void writeCookie(Session& session, bool destroyed, HttpResponse* resp);
+
 private:
-    std::unique_ptr<SessionStorage> storage_;
-    std::mt19937 rng_; // 用于生成随机会话id
+    std::unique_ptr<SessionStorage> storage_;   // 无状态模式下为空
+    std::unique_ptr<CookieSessionCodec> codec_; // 只有无状态模式有
+    std::string  cookieName_;
 };
 
 } // namespace session
@@ -1,6 +1,14 @@
 #pragma once
 #include "Session.h"
+#include <array>
+#include <condition_variable>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace http
 {
@@ -14,18 +22,107 @@ public:
     virtual void save(std::shared_ptr<Session> session) = 0;
     virtual std::shared_ptr<Session> load(const std::string& sessionId) = 0;
     virtual void remove(const std::string& sessionId) = 0;
+
+    // 请求结束的时候写回这次请求对会话的改动，一个请求只调用一次
+    // 默认有任何改动就整个保存；远程的存储可以只写改过的 key，或者只刷新过期时间
+    virtual void flush(std::shared_ptr<Session> session, const SessionChanges& changes)
+    {
+        if(!changes.empty())
+        {
+            save(std::move(session));
+        }
+    }
+
+    // 清理过期的会话，SessionManager 定时调用；
+    // 存储自己会让数据过期的(例如带 TTL 的外部存储)不需要实现
+    virtual void cleanExpired() {}
+};
+
+struct MemorySessionConfig
+{
+    // 两个上限平均分到每个分片上，按分片淘汰：某个分片满了就淘汰它里面最久没有访问的会话，
+    // 所以总数没到上限的时候也可能淘汰；每个分片至少保留最近保存的一个会话
+    size_t maxSessions = 100000;        // 会话数量上限，超过之后淘汰最久没有访问的会话
+    size_t maxBytes = 256 << 20;        // 会话数据总的内存上限，按 Session::approximateSize 计算
+    size_t sweepBatch = 256;            // 每次清理每个分片最多检查多少个到期的会话，避免长时间拿着锁
+
+    std::string snapshotPath;           // 不为空的时候启动时从这个文件恢复会话，并且定期把会话写到这个文件
+    int snapshotIntervalSeconds = 60;   // 多久写一次快照，析构的时候还会再写一次
 };
 
 // 基于内存的会话存储实现
+// 每个 IO 线程都会调用 save / load，按会话 id 的哈希分成多个分片，每个分片一把锁，
+// 不同会话的请求基本落在不同的分片上，不会所有线程抢同一把锁
+//
+// 内存不会随着运行时间一直增长：
+//      每个分片有一个按过期时间排序的最小堆，cleanExpired 每次只弹出堆顶已经到期的一小批，
+//      会话中途被刷新过的，重新按新的过期时间放回堆里(懒删除，刷新的时候不需要动堆)
+//      数量和内存的上限平均分到每个分片，超过之后按 LRU 淘汰最久没有访问的会话
+//
+// 配置了 snapshotPath 的时候重启不会丢会话：
+//      后台线程定期写快照，每个分片只在锁里面拿一遍会话的共享指针，序列化和写文件都在锁外面，
+//      先写临时文件再 rename，任何时候磁盘上都是一个完整的快照
+//      启动的时候把快照 mmap 进来直接解析，已经过期的记录只读过期时间就按长度跳过，不解析内容
 class MemorySessionStorage : public SessionStorage
 {
 public:
+    explicit MemorySessionStorage(const MemorySessionConfig& config = MemorySessionConfig());
+    // 配置了快照的时候停止后台线程，再写最后一次快照
+    ~MemorySessionStorage();
+
     void save(std::shared_ptr<Session> session) override;
     std::shared_ptr<Session> load(const std::string& sessionId) override;
     void remove(const std::string& sessionId) override;
+    void flush(std::shared_ptr<Session> session, const SessionChanges& changes) override;
+    void cleanExpired() override;
+
+    // 当前的会话数量和内存，遍历所有分片
+    size_t size() const;
+    size_t bytes() const;
+
+    // 立刻把所有没有过期的会话写到 snapshotPath，成功返回 true；没有配置快照的时候返回 false
+    bool writeSnapshot();
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<Session>> sessions_;
+    using ExpiryEntry = std::pair<Session::Clock::rep, std::string>;   // 放进堆的时候的过期时间, 会话 id
+
+    struct Entry
+    {
+        std::shared_ptr<Session>                session;
+        size_t                                  bytes;
+        std::list<const std::string*>::iterator lruIt;
+    };
+
+    // 按 cache line 对齐，避免相邻分片的锁落在同一条 cache line 上
+    struct alignas(64) Shard
+    {
+        mutable std::mutex                          mutex;
+        std::unordered_map<std::string, Entry>      sessions;
+        std::list<const std::string*>               lru;        // 前面是最近访问的，指向 sessions 的 key
+        std::vector<ExpiryEntry>                    expiry;     // 最小堆，可能有已经删除或者刷新过的旧条目
+        size_t                                      bytes = 0;
+    };
+
+    static constexpr size_t kShardCount = 32;
+
+    Shard& shardFor(const std::string& sessionId);
+    void eraseLocked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+    void evictLocked(Shard& shard);
+    static void pushExpiry(Shard& shard, Session::Clock::rep when, const std::string& sessionId);
+
+    // 从 snapshotPath 恢复，返回恢复的会话数量，文件不存在返回 0
+    size_t restoreSnapshot();
+    void snapshotLoop();
+
+private:
+    MemorySessionConfig             config_;
+    std::array<Shard, kShardCount>  shards_;
+
+    std::mutex                      snapshotMutex_;     // 保护 running_
+    std::condition_variable         snapshotCond_;
+    std::mutex                      writeMutex_;        // 同一时间只有一个快照在写
+    bool                            running_;
+    std::thread                     snapshotThread_;
 };
 
 } // namespace session
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../metrics/Metrics.h"
+
+/*
+ * 请求追踪：记录一个请求在服务器里面每个阶段花的时间，用来分析某一个慢请求的时间花在了哪里
+ *
+ *      解析完请求之后 HttpServer 给请求挂一个 RequestTrace(只有 Tracer 打开的时候)，
+ *      之后路由匹配、每个中间件的 before / after、处理器、序列化、发送(TLS 的话包括加密)各自记一个阶段，
+ *      阶段的时间用单调时钟，导出的时候再换算成墙上时间
+ *
+ *      TracingMiddleware 负责 W3C traceparent：有上游的 trace id 就沿用，没有就生成，并且决定是否采样
+ *      没有经过 TracingMiddleware 的请求不会被导出
+ *
+ *      请求结束之后 RequestTrace 放进 Tracer 的队列，后台线程按批写到本地文件，
+ *      每一行是一个 OTLP 的 ExportTraceServiceRequest(JSON 编码)，可以直接交给 OpenTelemetry Collector 的 file receiver
+ *      IO 线程只是把指针放进队列，队列满了直接丢弃，不会因为磁盘慢阻塞请求
+*/
+
+namespace http
+{
+namespace trace
+{
+
+struct TraceConfig
+{
+    std::string exportPath = "traces.jsonl";    // 导出文件，追加写
+    std::string serviceName = "http-server";    // OTLP resource 的 service.name
+    double sampleRatio = 1.0;                   // 没有上游 traceparent 的请求按这个比例采样
+    size_t batchSize = 256;                     // 攒够这么多个请求就写一次
+    int flushIntervalMs = 1000;                 // 攒不够的时候最多等这么久
+    size_t maxQueueSize = 8192;                 // 队列上限，超过之后丢弃
+};
+
+// 一个阶段，时间是 metrics::nowMicros() 的单调时钟微秒
+struct Phase
+{
+    const char* name;           // 阶段名字，例如 route.match、handler
+    const char* detail;         // 可以为空，例如中间件的名字；必须是静态的字符串，导出是在后台线程做的
+    uint64_t    start;
+    uint64_t    end;
+};
+
+struct RequestTrace
+{
+    using TraceId = std::array<uint8_t, 16>;
+    using SpanId  = std::array<uint8_t, 8>;
+
+    // receiveMicros 是 muduo 读到数据的时间(墙上时间)，解析阶段从这里开始算
+    explicit RequestTrace(int64_t receiveMicros);
+
+    void addPhase(const char* name, const char* detail, uint64_t start, uint64_t end)
+    {
+        if(recording)
+        {
+            phases.push_back(Phase{name, detail, start, end});
+        }
+    }
+
+    // 解析 traceparent: 00-<32位十六进制 trace id>-<16位十六进制 parent id>-<2位十六进制 flags>
+    // 格式不对或者 id 全是 0 的时候返回 false，parentSampled 是上游的采样标记
+    bool parseTraceparent(const std::string& header, bool& parentSampled);
+    // 没有上游的时候生成新的 trace id
+    void startNewTrace();
+    // 发给下游服务的 traceparent，parent 是这个请求的 span
+    std::string traceparent() const;
+
+    // 单调时钟换算成 unix 纳秒
+    uint64_t toUnixNanos(uint64_t monoMicros) const
+    { return (wallAtCreate + (static_cast<int64_t>(monoMicros) - static_cast<int64_t>(monoAtCreate))) * 1000; }
+
+    TraceId             traceId {};
+    SpanId              spanId {};          // 这个请求的 span
+    SpanId              parentSpanId {};    // 上游的 span，没有上游的时候全是 0
+    bool                hasParent = false;
+    bool                recording = true;   // 决定不采样之后不再记录阶段
+    bool                sampled = false;    // TracingMiddleware 决定采样之后才会导出
+
+    int64_t             receiveWall;        // 微秒
+    int64_t             wallAtCreate;       // 微秒
+    uint64_t            monoAtCreate;       // 微秒
+    uint64_t            monoEnd = 0;
+
+    std::string         method;
+    std::string         path;
+    std::string         route;              // 匹配到的路由模式，例如 /users/{id:int}
+    std::string         peerIp;
+    int                 statusCode = 0;
+    std::vector<Phase>  phases;
+};
+
+// RAII 记录一个阶段，trace 为空的时候什么都不做
+class ScopedPhase
+{
+public:
+    ScopedPhase(RequestTrace* trace, const char* name, const char* detail = nullptr)
+        : trace_(trace)
+        , name_(name)
+        , detail_(detail)
+        , start_(trace ? metrics::nowMicros() : 0)
+    {}
+
+    ~ScopedPhase()
+    { finish(); }
+
+    // 提前结束这个阶段
+    void finish()
+    {
+        if(trace_)
+        {
+            trace_->addPhase(name_, detail_, start_, metrics::nowMicros());
+            trace_ = nullptr;
+        }
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    RequestTrace*   trace_;
+    const char*     name_;
+    const char*     detail_;
+    uint64_t        start_;
+};
+
+// 单例模式，和 MetricsRegistry 一样使用 local static
+class Tracer
+{
+public:
+    static Tracer& getInstance()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    // 打开追踪并启动导出线程，只有第一次调用的配置生效
+    void start(const TraceConfig& config);
+    // 把队列里面剩下的写完，停止导出线程
+    void stop();
+
+    bool enabled() const
+    { return enabled_.load(std::memory_order_relaxed); }
+
+    double sampleRatio() const
+    { return sampleRatio_; }
+
+    // 请求结束的时候调用，只有采样了的请求会被放进队列
+    void submit(std::shared_ptr<RequestTrace> trace);
+
+    uint64_t dropped() const
+    { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    Tracer() = default;
+    ~Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    void exportLoop();
+    std::string renderBatch(const std::vector<std::shared_ptr<RequestTrace>>& batch) const;
+
+private:
+    std::mutex                                      mutex_;
+    std::condition_variable                         cond_;
+    std::vector<std::shared_ptr<RequestTrace>>      queue_;
+    std::thread                                     thread_;
+    bool                                            running_ = false;
+    TraceConfig                                     config_;
+    double                                          sampleRatio_ = 1.0;
+    std::atomic<bool>                               enabled_ { false };
+    std::atomic<uint64_t>                           dropped_ { 0 };
+};
+
+} // namespace trace
+} // namespace http
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace http
+{
+
+// base64url(RFC 4648 第 5 节)：'-' 和 '_' 代替 '+' 和 '/'
+// 编码不带末尾的 '='，放进 URL、cookie 和 JWT 里面都不需要转义；解码的时候有没有 '=' 都接受
+class Base64Url
+{
+public:
+    static std::string encode(const std::string& data)
+    {
+        static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        std::string out;
+        out.reserve((data.size() * 4 + 2) / 3);
+        uint32_t buffer = 0;
+        int bits = 0;
+        for(unsigned char c : data)
+        {
+            buffer = (buffer << 8) | c;
+            bits += 8;
+            while(bits >= 6)
+            {
+                bits -= 6;
+                out.push_back(kAlphabet[(buffer >> bits) & 0x3F]);
+            }
+        }
+        if(bits > 0)
+        {
+            out.push_back(kAlphabet[(buffer << (6 - bits)) & 0x3F]);
+        }
+        return out;
+    }
+
+    // 有不属于 base64url 的字符或者长度不对的时候返回 false
+    static bool decode(const char* data, size_t len, std::string& out)
+    {
+        while(len > 0 && data[len - 1] == '=')
+        {
+            --len;
+        }
+        if(len % 4 == 1)
+        {
+            return false;
+        }
+
+        out.clear();
+        out.reserve(len * 3 / 4);
+        uint32_t buffer = 0;
+        int bits = 0;
+        for(size_t i = 0; i < len; ++i)
+        {
+            char c = data[i];
+            int value;
+            if(c >= 'A' && c <= 'Z') value = c - 'A';
+            else if(c >= 'a' && c <= 'z') value = c - 'a' + 26;
+            else if(c >= '0' && c <= '9') value = c - '0' + 52;
+            else if(c == '-') value = 62;
+            else if(c == '_') value = 63;
+            else return false;
+
+            buffer = (buffer << 6) | static_cast<uint32_t>(value);
+            bits += 6;
+            if(bits >= 8)
+            {
+                bits -= 8;
+                out.push_back(static_cast<char>((buffer >> bits) & 0xFF));
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace http
@@ -2,6 +2,7 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 #include <cppconn/connection.h>
 #include <cppconn/prepared_statement.h>
 #include <cppconn/resultset.h>
@@ -71,6 +72,9 @@ public:
         }
     }
 
+    // 参数个数运行时才知道的语句(例如多行 INSERT)，所有参数都按字符串绑定
+    int executeBatchUpdate(const std::string& sql, const std::vector<std::string>& params);
+
     // 添加检测连接是否有效的方法
     bool ping();
 
@@ -21,12 +21,25 @@ g++ -std=c++17 -Wall -Wextra \
     src/http/HttpRequest.cc \
     src/http/HttpResponse.cc \
     src/http/HttpContext.cc \
+    src/http/ThreadPlacement.cc \
+    src/http/VirtualHost.cc \
     src/router/Router.cc \
+    src/router/RouteTree.cc \
+    src/metrics/Metrics.cc \
+    src/trace/Tracer.cc \
     src/middleware/MiddlewareChain.cc \
     src/middleware/cors/CorsMiddleware.cc \
+    src/middleware/cors/CorsPolicy.cc \
+    src/middleware/cache/CacheMiddleware.cc \
+    src/middleware/ratelimit/RateLimitMiddleware.cc \
+    src/middleware/auth/JwtMiddleware.cc \
+    src/middleware/tracing/TracingMiddleware.cc \
     src/session/Session.cc \
     src/session/SessionManager.cc \
     src/session/SessionStorage.cc \
+    src/session/RedisSessionStorage.cc \
+    src/session/MysqlSessionStorage.cc \
+    src/session/CookieSessionCodec.cc \
     src/ssl/SslContext.cc \
     src/ssl/SslConnection.cc \
     src/ssl/SslConfig.cc \
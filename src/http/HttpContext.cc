@@ -96,8 +96,8 @@ bool HttpContext::parseRequest(muduo::net::Buffer* buf, muduo::Timestamp receive
             }
 
             // 否则我们可以读，但是只能读取指定的长度: Content-Length 指定的长度
-            std::string body(buf->peek(), buf->peek() + request_.contentLength());
-            request_.setBody(body);
+            // 直接从缓冲区拷贝到请求里面，不经过临时字符串
+            request_.setBody(buf->peek(), buf->peek() + request_.contentLength());
 
             // 准确移动指针
             buf->retrieve(request_.contentLength());
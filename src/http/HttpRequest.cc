@@ -42,6 +42,20 @@ bool HttpRequest::setMethod(const char* start, const char* end)
     return method_ != kInvalid;
 }
 
+const char* HttpRequest::methodString(Method method)
+{
+    switch(method)
+    {
+        case kGet:      return "GET";
+        case kPost:     return "POST";
+        case kHead:     return "HEAD";
+        case kPut:      return "PUT";
+        case kDelete:   return "DELETE";
+        case kOptions:  return "OPTIONS";
+        default:        return "UNKNOWN";
+    }
+}
+
 void HttpRequest::setPath(const char* start, const char* end)
 {   
     path_.assign(start, end); // 也是range 拷贝方法
@@ -63,6 +77,38 @@ std::string HttpRequest::getPathParameters(const std::string& key) const
     return "";
 }
 
+void HttpRequest::setPathParameters(const std::string& key, int64_t value)
+{
+    intPathParameters_[key] = value;
+}
+
+void HttpRequest::setPathParameters(const std::string& key, const Uuid& value)
+{
+    uuidPathParameters_[key] = value;
+}
+
+bool HttpRequest::getPathParameters(const std::string& key, int64_t& value) const
+{
+    auto it = intPathParameters_.find(key);
+    if(it == intPathParameters_.end())
+    {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+bool HttpRequest::getPathParameters(const std::string& key, Uuid& value) const
+{
+    auto it = uuidPathParameters_.find(key);
+    if(it == uuidPathParameters_.end())
+    {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
 // 这个是从问号后面去分割参数
 // 比如我在一个浏览器里面输入: http://127.0.0.1:8000/search?keyword=cpp 
 // 那么浏览器就会在底层构建如下的文本给你的服务器:
@@ -81,7 +127,8 @@ std::string HttpRequest::getPathParameters(const std::string& key) const
 void HttpRequest::setQueryParameters(const char* start, const char* end)
 {
     // 所谓的query parameters 就是从问号后面去分割参数
-    std::string argumentStr(start, end);
+    query_.assign(start, end);
+    const std::string& argumentStr = query_;
     std::string::size_type pos = 0;
     std::string::size_type prev = 0;
 
@@ -147,6 +194,12 @@ void HttpRequest::addHeader(const char* start, const char* colon, const char* en
         value.resize(value.size() - 1);
     }
 
+    if(key == "Cookie")
+    {
+        // 值要被替换掉了，之前解析出来的 cookie 指向的是旧的值
+        cookies_.clear();
+        cookiesParsed_ = false;
+    }
     headers_[key] = value;
 }
 
@@ -162,15 +215,96 @@ std::string HttpRequest::getHeader(const std::string& field) const
     return result;
 }
 
+const std::vector<HttpRequest::CookieView>& HttpRequest::cookies() const
+{
+    if(cookiesParsed_)
+    {
+        return cookies_;
+    }
+    cookiesParsed_ = true;
+
+    auto it = headers_.find("Cookie");
+    if(it == headers_.end())
+    {
+        return cookies_;
+    }
+
+    // cookie-string = cookie-pair *( ";" SP cookie-pair )，对不规范的分隔和空白宽松一点
+    std::string_view header(it->second);
+    auto isSpace = [](char c) { return c == ' ' || c == '\t'; };
+    size_t pos = 0;
+    while(pos < header.size())
+    {
+        size_t end = header.find(';', pos);
+        if(end == std::string_view::npos)
+        {
+            end = header.size();
+        }
+        std::string_view pair = header.substr(pos, end - pos);
+        pos = end + 1;
+
+        while(!pair.empty() && isSpace(pair.front())) pair.remove_prefix(1);
+        while(!pair.empty() && isSpace(pair.back())) pair.remove_suffix(1);
+
+        // 没有 '=' 或者名字为空的不是合法的 cookie-pair，跳过
+        size_t eq = pair.find('=');
+        if(eq == std::string_view::npos)
+        {
+            continue;
+        }
+        std::string_view name = pair.substr(0, eq);
+        std::string_view value = pair.substr(eq + 1);
+        while(!name.empty() && isSpace(name.back())) name.remove_suffix(1);
+        while(!value.empty() && isSpace(value.front())) value.remove_prefix(1);
+        if(name.empty())
+        {
+            continue;
+        }
+        // cookie-value 可以用双引号括起来，引号不是值的一部分
+        if(value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            value = value.substr(1, value.size() - 2);
+        }
+        cookies_.emplace_back(name, value);
+    }
+    return cookies_;
+}
+
+bool HttpRequest::getCookie(std::string_view name, std::string_view& value) const
+{
+    for(const auto& cookie : cookies())
+    {
+        if(cookie.first == name)
+        {
+            value = cookie.second;
+            return true;
+        }
+    }
+    return false;
+}
+
 void HttpRequest::swap(HttpRequest& that)
 {
     std::swap(method_, that.method_);
     std::swap(path_, that.path_);
     std::swap(pathParameters_, that.pathParameters_);
+    std::swap(intPathParameters_, that.intPathParameters_);
+    std::swap(uuidPathParameters_, that.uuidPathParameters_);
     std::swap(queryParameters_, that.queryParameters_);
+    std::swap(query_, that.query_);
     std::swap(version_, that.version_);
     std::swap(headers_, that.headers_);
+    std::swap(cookies_, that.cookies_);     // std::map 交换的时候节点不动，cookie 指向的值还在
+    std::swap(cookiesParsed_, that.cookiesParsed_);
     std::swap(receiveTime_, that.receiveTime_);
+    std::swap(peerIp_, that.peerIp_);
+    std::swap(claims_, that.claims_);
+    std::swap(trace_, that.trace_);
+    std::swap(parked_, that.parked_);
+    std::swap(parkable_, that.parkable_);
+    std::swap(resumed_, that.resumed_);
+    std::swap(content_, that.content_);
+    std::swap(contentLength_, that.contentLength_);
 }
 
 } // namespace http
\ No newline at end of file
@@ -32,6 +32,31 @@ void HttpResponse::appendToBuffer(muduo::net::Buffer* outputBuf) const
         outputBuf->append("Connection: Keep-Alive\r\n");
     }
 
+    if(prerendered_)
+    {
+        // 缓存命中之后其它中间件在 after 阶段加的响应头，放在缓存的响应头前面
+        for(const auto& header : headers_)
+        {
+            outputBuf->append(header.first);
+            outputBuf->append(": ");
+            outputBuf->append(header.second);
+            outputBuf->append("\r\n");
+        }
+        outputBuf->append(*prerendered_);
+        return;
+    }
+    appendHeadersAndBody(outputBuf);
+}
+
+std::string HttpResponse::renderHeadersAndBody() const
+{
+    muduo::net::Buffer buf;
+    appendHeadersAndBody(&buf);
+    return buf.retrieveAllAsString();
+}
+
+void HttpResponse::appendHeadersAndBody(muduo::net::Buffer* outputBuf) const
+{
     for(const auto& header : headers_)
     {
         outputBuf->append(header.first);
@@ -40,8 +65,22 @@ void HttpResponse::appendToBuffer(muduo::net::Buffer* outputBuf) const
         outputBuf->append("\r\n");
     }
 
+    // 204 和 304 没有 body，也不加 Content-Length，客户端不会去读 body
+    bool hasBody = statusCode_ != k204NoContent && statusCode_ != k304NotModified;
+
+    // 没有 Content-Length 的话，keep-alive 的客户端不知道 body 在哪里结束
+    if(hasBody && headers_.find("Content-Length") == headers_.end())
+    {
+        outputBuf->append("Content-Length: ");
+        outputBuf->append(std::to_string(body_.size()));
+        outputBuf->append("\r\n");
+    }
+
     outputBuf->append("\r\n");
-    outputBuf->append(body_);
+    if(hasBody)
+    {
+        outputBuf->append(body_);
+    }
 }
 
 
@@ -1,5 +1,7 @@
 #include "../../include/http/HttpServer.h"
+#include "../../include/trace/Tracer.h"
 
+#include <algorithm>
 #include <any>
 #include <functional>
 #include <memory>
@@ -24,6 +26,37 @@ void HttpServer::start()
 {
     LOG_WARN << "HttpServer[" << server_.name() << "] starts listening on" << server_.ipPort();
     server_.start();            // 设置acceptor, 开启线程池，并在mainLoop 中run in loop 开始监听，并且设置channel 对读事件感兴趣
+
+    // 线程池启动之后才知道有哪些 IO loop，从这以后运行时修改路由，旧路由表等所有 IO loop 都经过静止点再释放
+    auto reclaimer = std::bind(&HttpServer::reclaimAfterQuiescence, this, std::placeholders::_1);
+    defaultHost_.setReclaimer(reclaimer);
+    for(auto& host : hosts_)
+    {
+        host.second->setReclaimer(reclaimer);
+    }
+
+    // 过期的会话不会等到有人访问才删除，定时在后台一点一点清理掉
+    if(sessionManager_)
+    {
+        mainLoop_.runEvery(session::SessionManager::kCleanIntervalSeconds, [this] {
+            sessionManager_->cleanExpiredSessions();
+        });
+    }
+
+    // mainLoop 就运行在调用 start() 的线程上。新线程会继承创建它的线程的 CPU 亲和性和内存策略，
+    // 所以要等线程池启动之后再绑定，不然没有配置 ioLoopCpus 的时候所有 IO 线程都会挤在 mainLoop 的核上；
+    // 之后在这个线程上创建的线程同样会继承，需要的话在绑定之前创建
+    if(!placement_.mainLoopCpus.empty())
+    {
+        mainLoop_.runInLoop([this] {
+            ThreadPlacement::pinCurrentThread(placement_.mainLoopCpus);
+            if(placement_.bindMemoryToNode)
+            {
+                ThreadPlacement::preferLocalMemory(placement_.mainLoopCpus);
+            }
+        });
+    }
+
     mainLoop_.loop();           // mainLoop 开启其下面的 Poller wait 在对应的 channel上
 }
 
@@ -41,6 +74,35 @@ void HttpServer::initialize(const ssl::SslConfig& sslConfig)
     }
 }
 
+void HttpServer::setThreadPlacement(const ThreadPlacement& placement)
+{
+    placement_ = placement;
+    nextIoLoop_ = 0;
+    // muduo 在每个 IO 线程里面、loop 开始之前调用这个回调
+    server_.setThreadInitCallback(std::bind(&HttpServer::onThreadInit, this, std::placeholders::_1));
+}
+
+void HttpServer::onThreadInit(muduo::net::EventLoop* /* loop */)
+{
+    if(placement_.ioLoopCpus.empty())
+    {
+        return;
+    }
+
+    int index = nextIoLoop_++;
+    const std::vector<int>& cpus = placement_.ioLoopCpus[index % placement_.ioLoopCpus.size()];
+    if(ThreadPlacement::pinCurrentThread(cpus))
+    {
+        LOG_INFO << "IO loop " << index << " pinned to CPU " << cpus.front();
+    }
+
+    // 先绑核再设置内存策略，之后这个 loop 上第一次分配(first touch)的内存都来自本地节点
+    if(placement_.bindMemoryToNode)
+    {
+        ThreadPlacement::preferLocalMemory(cpus);
+    }
+}
+
 void HttpServer::setSslConfig(const ssl::SslConfig& config)
 {
     if(useSSL_)
@@ -54,6 +116,16 @@ void HttpServer::setSslConfig(const ssl::SslConfig& config)
     }
 }
 
+void HttpServer::enableMetrics(const std::string& path)
+{
+    metrics::MetricsRegistry::getInstance().setEnabled(true);
+    Get(path, [](const HttpRequest&, HttpResponse* resp) {
+        resp->setStatusLine("HTTP/1.1", HttpResponse::k200Ok, "OK");
+        resp->setContentType("text/plain; version=0.0.4");
+        resp->setBody(metrics::MetricsRegistry::getInstance().renderPrometheus());
+    });
+}
+
 void HttpServer::onConnection(const muduo::net::TcpConnectionPtr& conn)
 {
     // 设置onConnection
@@ -96,7 +168,8 @@ void HttpServer::onConnection(const muduo::net::TcpConnectionPtr& conn)
         // 解析了一般，然后这个local 变量被销毁了，下次onMessage回调还是创建新的 context，所以我们
         // 就在创建连接的时候，把它放到 TcpConn 的context里面实现持久化
         // 下次 onMessage 的时候，拿出来继续parse就是了
-        conn->setContext(HttpContext());
+        // boost::any 要求存进去的类型可以拷贝，而 HttpRequest 是只能移动的，所以这里存的是 shared_ptr
+        conn->setContext(std::make_shared<HttpContext>());
     }
     else
     {
@@ -119,36 +192,74 @@ void HttpServer::onMessage(const muduo::net::TcpConnectionPtr&conn,
 {
     // 【删除】所有关于 useSSL_ 的判断、find sslConns、手动调用 onRead 的代码全部删掉！
     // 因为这部分工作已经由 SslConnection::onRead 在底层做完了，并回调到了这里。
-    HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    HttpContext *context = boost::any_cast<std::shared_ptr<HttpContext>>(conn->getMutableContext())->get();
+
+    // 前面有一个请求被挂起了，它的响应发出去之前不处理后面的请求，数据留在缓冲区里面，恢复之后接着解析
+    if(context->parked())
+    {
+        return;
+    }
 
     // 直接解析，这里的buf已经是明文了！！！！
-    if(!context->parseRequest(buf, receiveTime))
+    // 客户端可能一次发来多个请求(pipelining)，要一直解析到 buf 里面没有完整的请求为止
+    while(conn->connected())
     {
-        // 【代码修正】 错误消息也要区分 SSL
-        const char* errorMsg = "HTTP/1.1 400 Bad Request\r\n\r\n";
-        if(useSSL_)
+        size_t readable = buf->readableBytes();
+        bool parsed = context->parseRequest(buf, receiveTime);
+        if(metrics::MetricsRegistry::getInstance().enabled())
         {
-            auto it = sslConnections_.find(conn);
-            if(it != sslConnections_.end())
+            metrics::MetricsRegistry::getInstance().local().bytesIn.add(readable - buf->readableBytes());
+        }
+
+        if(!parsed)
+        {
+            // 【代码修正】 错误消息也要区分 SSL
+            const char* errorMsg = "HTTP/1.1 400 Bad Request\r\n\r\n";
+            if(useSSL_)
             {
-                it->second->send(errorMsg, strlen(errorMsg));
+                auto it = sslConnections_.find(conn);
+                if(it != sslConnections_.end())
+                {
+                    it->second->send(errorMsg, strlen(errorMsg));
+                }
+            }
+            else{
+                conn->send(errorMsg);
             }
+            conn->shutdown();
+            return;
         }
-        else{
-            conn->send(errorMsg);
+
+        if(!context->gotAll())
+        {
+            break;  // 请求还不完整，等待更多数据
         }
-        conn->shutdown();
-    }
 
-    if(context->gotAll())
-    {
         // 拿到request 之后，直接去处理request了
+        context->request().setPeerIp(conn->peerAddress().toIp());
+        if(trace::Tracer::getInstance().enabled())
+        {
+            // 解析阶段从 muduo 读到数据的时间算到现在
+            context->request().setTrace(std::make_shared<trace::RequestTrace>(receiveTime.microSecondsSinceEpoch()));
+        }
+        context->request().setParkable(true);
         onRequest(conn, context->request());
+        if(context->request().parked())
+        {
+            parkRequest(conn, buf, context, context->request());
+            break;
+        }
         context->reset();
+
+        if(buf->readableBytes() == 0)
+        {
+            break;
+        }
     }
 }
 
-void HttpServer::onRequest(const muduo::net::TcpConnectionPtr& conn, const HttpRequest& req)
+// req 就是 HttpContext 里面解析出来的那个请求，一路以引用的形式传给中间件、路由和处理器
+void HttpServer::onRequest(const muduo::net::TcpConnectionPtr& conn, HttpRequest& req)
 {
     // 1. 构造response 需要 close 看是保持连接，还是短连接
     const std::string &connection = req.getHeader("Connection");
@@ -156,17 +267,43 @@ void HttpServer::onRequest(const muduo::net::TcpConnectionPtr& conn, const HttpR
 
     HttpResponse response(close);
 
+    bool recordMetrics = metrics::MetricsRegistry::getInstance().enabled();
+    uint64_t start = recordMetrics ? metrics::nowMicros() : 0;
+
     // 2. 根据请求报文信息，封装响应报文对象
     httpCallback_(req, &response);   // 执行onHttpCallback 函数
 
+    // 处理器对会话的修改在这里合并成一次写回，要在发送响应之前，保证客户端下一个请求能读到
+    if(sessionManager_)
+    {
+        trace::ScopedPhase flush(req.trace(), "session.flush");
+        sessionManager_->flushSessions();
+    }
+    else
+    {
+        session::SessionManager::discardPendingSessions();
+    }
+
+    // 请求被中间件挂起了，这次没有响应，由 onMessage 保存起来等它恢复
+    if(req.parked())
+    {
+        return;
+    }
+
     // 可以给response 设置一个成员，判断是否请求的是文件，如果是则设置为true，并且存在文件位置在这里send出去
+    trace::RequestTrace* trace = req.trace();
+    trace::ScopedPhase serialize(trace, "serialize");
     muduo::net::Buffer buf;
     // 序列化输出到buf里面
     response.appendToBuffer(&buf);
+    serialize.finish();
     // 打印完整的内容响应用于调试
     LOG_INFO << "Sending response:\n" << buf.toStringPiece().as_string();
     LOG_INFO << "USE SSL ? " << useSSL_;
+    size_t responseBytes = buf.readableBytes();
     // 【代码修正】发送数据分流处理
+    // TLS 的话这个阶段包括加密，发送是写到 socket 的缓冲区，不包括对端收到的时间
+    trace::ScopedPhase send(trace, useSSL_ ? "tls.send" : "send");
     if(useSSL_)
     {
         auto it = sslConnections_.find(conn);
@@ -181,6 +318,31 @@ void HttpServer::onRequest(const muduo::net::TcpConnectionPtr& conn, const HttpR
         conn->send(&buf);
     }
     // 【修正结束】
+    send.finish();
+
+    if(recordMetrics)
+    {
+        // 只写当前 IO 线程自己的那份计数器
+        metrics::ThreadMetrics& m = metrics::MetricsRegistry::getInstance().local();
+        m.requests.add();
+        int code = response.getStatusCode();
+        if(code >= 0 && code < metrics::ThreadMetrics::kMaxStatusCode)
+        {
+            m.statusCodes[code].add();
+        }
+        m.bytesOut.add(responseBytes);
+        m.requestLatency.record(metrics::nowMicros() - start);
+    }
+
+    if(trace)
+    {
+        trace->monoEnd = metrics::nowMicros();
+        trace->method = HttpRequest::methodString(req.method());
+        trace->path = req.path();
+        trace->peerIp = req.peerIp();
+        trace->statusCode = response.getStatusCode();
+        trace::Tracer::getInstance().submit(req.releaseTrace());
+    }
 
     // 如果是短链接，返回响应报文之后就断开
     if(response.closeConnection())
@@ -189,31 +351,68 @@ void HttpServer::onRequest(const muduo::net::TcpConnectionPtr& conn, const HttpR
     }
 }
 
-void HttpServer::handleRequest(const HttpRequest& req, HttpResponse* resp)
+void HttpServer::parkRequest(const muduo::net::TcpConnectionPtr& conn, muduo::net::Buffer* buf,
+                             HttpContext* context, HttpRequest& req)
 {
-    try
+    // 请求原样保存下来，恢复的时候从头再处理一遍；buf 是 TcpConnection 或者 SslConnection 的缓冲区，
+    // 和连接的生命周期一样，恢复的时候先确认连接还在
+    std::shared_ptr<ParkedRequest> parked = req.releaseParked();
+    auto saved = std::make_shared<HttpRequest>(std::move(req));
+    context->reset();
+    context->setParked(true);
+
+    std::weak_ptr<muduo::net::TcpConnection> weak(conn);
+    muduo::net::EventLoop* loop = conn->getLoop();
+    parked->bind([this, weak, loop, saved, buf] {
+        // 可能在别的 IO 线程上被恢复，也可能就在这个线程正在处理的事件里面，都投递到连接的 loop 上以后再处理
+        loop->queueInLoop([this, weak, saved, buf] {
+            if(auto conn = weak.lock())
+            {
+                resumeRequest(conn, saved, buf);
+            }
+        });
+    });
+}
+
+void HttpServer::resumeRequest(const muduo::net::TcpConnectionPtr& conn, const std::shared_ptr<HttpRequest>& req,
+                               muduo::net::Buffer* buf)
+{
+    if(!conn->connected())
     {
-        // 处理请求前的中间件
-        HttpRequest mutableReq = req;
-        middlewareChain_.processBefore(mutableReq);
+        return;
+    }
 
-        // 路由处理
-        if(!router_.route(mutableReq, resp))
-        {
-            LOG_INFO << "请求的URL: " << req.method() << " " << req.path();
-            LOG_INFO << "未找到路由, 返回404";
-            resp->setStatusCode(HttpResponse::k404NotFound);
-            resp->setStatusMessage("Not Found");
-            resp->setCloseConnection(true);
-        }
+    HttpContext *context = boost::any_cast<std::shared_ptr<HttpContext>>(conn->getMutableContext())->get();
+    context->setParked(false);
+    req->setResumed();
+    onRequest(conn, *req);
+    if(req->parked())
+    {
+        parkRequest(conn, buf, context, *req);
+        return;
+    }
+
+    // 挂起期间收到的请求接着处理
+    if(buf->readableBytes() > 0)
+    {
+        onMessage(conn, buf, muduo::Timestamp::now());
+    }
+}
 
-        // 处理响应后的中间件
-        middlewareChain_.processAfter(*resp);
+void HttpServer::handleRequest(HttpRequest& req, HttpResponse* resp)
+{
+    try
+    {
+        // 先按 Host 选出虚拟主机，再走它自己的中间件和路由
+        selectHost(req).handle(req, resp);
     }
     catch (const HttpResponse& res)
     {
-        // 处理中间件抛出的响应( CorsMiddleware.cc 代码27行)
+        // 兼容以前用 throw 提前返回响应的写法，现在的中间件应该在 before 里面返回 kRespond
+        // 是否保持连接还是按请求头来决定，不用中间件里面构造响应时的默认值
+        bool close = resp->closeConnection();
         *resp = res;
+        resp->setCloseConnection(close);
     }
     catch(const std::exception& e)
     {
@@ -223,4 +422,76 @@ void HttpServer::handleRequest(const HttpRequest& req, HttpResponse* resp)
     }
 }
 
+// 给每个 IO loop 投递一个任务，loop 执行到这个任务的时候，之前正在处理的事件一定已经处理完了，
+// 不会再持有旧路由表的指针；最后一个执行到的 loop 负责释放
+void HttpServer::reclaimAfterQuiescence(std::function<void()> reclaim)
+{
+    std::vector<muduo::net::EventLoop*> loops = server_.threadPool()->getAllLoops();
+    auto pending = std::make_shared<std::atomic<size_t>>(loops.size());
+    auto shared = std::make_shared<std::function<void()>>(std::move(reclaim));
+    for(muduo::net::EventLoop* loop : loops)
+    {
+        loop->queueInLoop([pending, shared] {
+            if(pending->fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                (*shared)();
+            }
+        });
+    }
+}
+
+VirtualHost& HttpServer::addVirtualHost(const std::string& host)
+{
+    std::string name;
+    bool wildcard = host.compare(0, 2, "*.") == 0;
+    VirtualHost::normalizeHost(wildcard ? std::string_view(host).substr(1) : std::string_view(host), name);
+
+    auto it = hosts_.find(wildcard ? "*" + name : name);
+    if(it != hosts_.end())
+    {
+        return *it->second;
+    }
+
+    // 通配的主机也放在 hosts_ 里面(key 带上 * 前缀)，只是为了管理它的生命周期
+    auto vhost = std::make_unique<VirtualHost>();
+    VirtualHost* raw = vhost.get();
+    hosts_.emplace(wildcard ? "*" + name : name, std::move(vhost));
+    if(wildcard)
+    {
+        wildcardHosts_.emplace_back(name, raw);
+        std::stable_sort(wildcardHosts_.begin(), wildcardHosts_.end(),
+                         [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+    }
+    return *raw;
+}
+
+VirtualHost& HttpServer::selectHost(const HttpRequest& req)
+{
+    // 没有配置虚拟主机的时候不需要看 Host
+    if(hosts_.empty())
+    {
+        return defaultHost_;
+    }
+
+    // 每个 IO 线程复用同一块内存，查表不需要每次分配
+    thread_local std::string host;
+    VirtualHost::normalizeHost(req.getHeader("Host"), host);
+
+    auto it = hosts_.find(host);
+    if(it != hosts_.end())
+    {
+        return *it->second;
+    }
+
+    for(const auto& [suffix, vhost] : wildcardHosts_)
+    {
+        if(host.size() > suffix.size()
+           && host.compare(host.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            return *vhost;
+        }
+    }
+    return defaultHost_;
+}
+
 } // namespace http
@@ -0,0 +1,337 @@
+#include "../../include/http/ThreadPlacement.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <muduo/base/Logging.h>
+
+namespace http
+{
+
+namespace
+{
+
+// 和 <linux/mempolicy.h> 中的定义一致，这里不依赖 libnuma
+const int kMpolPreferred = 1;
+
+std::string readFirstLine(const std::string& path)
+{
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+std::string toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+// 中断当前生效的亲和性，取第一个 CPU
+int irqCpu(int irq)
+{
+    std::string base = "/proc/irq/" + std::to_string(irq);
+    std::vector<int> cpus = ThreadPlacement::parseCpuList(readFirstLine(base + "/effective_affinity_list"));
+    if(cpus.empty())
+    {
+        cpus = ThreadPlacement::parseCpuList(readFirstLine(base + "/smp_affinity_list"));
+    }
+    return cpus.empty() ? -1 : cpus.front();
+}
+
+} // namespace
+
+ThreadPlacement ThreadPlacement::fromNumaNode(int node, int numThreads)
+{
+    ThreadPlacement placement;
+    std::vector<int> cpus = cpusOfNumaNode(node);
+    if(cpus.empty())
+    {
+        LOG_WARN << "No CPUs found on NUMA node " << node << ", thread placement disabled";
+        return placement;
+    }
+
+    placement.mainLoopCpus = { cpus[0] };
+    for(int i = 0; i < numThreads; ++i)
+    {
+        // CPU 不够的时候从头开始复用，但尽量不和 mainLoop 挤在一起
+        size_t index = cpus.size() > 1 ? 1 + i % (cpus.size() - 1) : 0;
+        placement.ioLoopCpus.push_back({ cpus[index] });
+    }
+    return placement;
+}
+
+ThreadPlacement ThreadPlacement::fromNicQueues(const std::string& interface, int numThreads)
+{
+    ThreadPlacement placement;
+    std::vector<int> queueCpus = nicQueueCpus(interface);
+    if(queueCpus.empty())
+    {
+        LOG_WARN << "No RX queue interrupts found for " << interface << ", thread placement disabled";
+        return placement;
+    }
+
+    for(int i = 0; i < numThreads; ++i)
+    {
+        placement.ioLoopCpus.push_back({ queueCpus[i % queueCpus.size()] });
+    }
+
+    // mainLoop 只负责 accept，放到同一个 NUMA 节点上不处理网卡中断的核上
+    int node = numaNodeOfCpu(queueCpus.front());
+    for(int cpu : cpusOfNumaNode(node))
+    {
+        if(std::find(queueCpus.begin(), queueCpus.end(), cpu) == queueCpus.end())
+        {
+            placement.mainLoopCpus = { cpu };
+            break;
+        }
+    }
+    return placement;
+}
+
+bool ThreadPlacement::pinCurrentThread(const std::vector<int>& cpus)
+{
+    if(cpus.empty())
+    {
+        return true;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus)
+    {
+        if(cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if(ret != 0)
+    {
+        LOG_ERROR << "pthread_setaffinity_np failed: " << ret;
+        return false;
+    }
+    return true;
+}
+
+bool ThreadPlacement::preferLocalMemory(const std::vector<int>& cpus)
+{
+    if(cpus.empty())
+    {
+        return true;
+    }
+
+    int node = numaNodeOfCpu(cpus.front());
+    if(node < 0)
+    {
+        // 非 NUMA 机器上没有 node 目录，什么都不用做
+        return true;
+    }
+
+    unsigned long mask[16] = { 0 };
+    const int bitsPerWord = sizeof(unsigned long) * 8;
+    if(node >= static_cast<int>(sizeof mask * 8))
+    {
+        return false;
+    }
+    mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+
+    // MPOL_PREFERRED：本地节点内存不够时还可以退回到其它节点，不会因此 OOM
+    if(syscall(SYS_set_mempolicy, kMpolPreferred, mask, sizeof mask * 8) != 0)
+    {
+        LOG_WARN << "set_mempolicy failed for NUMA node " << node;
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> ThreadPlacement::parseCpuList(const std::string& list)
+{
+    // 格式不对的项(例如 "3-"、超出范围的数字)直接跳过，不抛异常
+    auto parseCpu = [](const std::string& text, int& cpu) {
+        if(text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])))
+        {
+            return false;
+        }
+        errno = 0;
+        char* end = nullptr;
+        long value = strtol(text.c_str(), &end, 10);
+        while(*end && std::isspace(static_cast<unsigned char>(*end)))
+        {
+            ++end;
+        }
+        if(errno != 0 || *end || value >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        cpu = static_cast<int>(value);
+        return true;
+    };
+
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string item;
+    while(std::getline(ss, item, ','))
+    {
+        item.erase(0, item.find_first_not_of(" \t"));
+        std::string::size_type dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if(dash == std::string::npos)
+        {
+            if(parseCpu(item, first))
+            {
+                cpus.push_back(first);
+            }
+        }
+        else if(parseCpu(item.substr(0, dash), first) && parseCpu(item.substr(dash + 1), last))
+        {
+            for(int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+int ThreadPlacement::numaNodeOfCpu(int cpu)
+{
+    // /sys/devices/system/cpu/cpuN/ 下面会有一个 nodeK 的链接
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if(!dir)
+    {
+        return -1;
+    }
+
+    int node = -1;
+    while(struct dirent* entry = readdir(dir))
+    {
+        if(strncmp(entry->d_name, "node", 4) == 0 && std::isdigit(static_cast<unsigned char>(entry->d_name[4])))
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+std::vector<int> ThreadPlacement::cpusOfNumaNode(int node)
+{
+    std::vector<int> cpus = parseCpuList(readFirstLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    if(cpus.empty() && node == 0)
+    {
+        // 非 NUMA 机器：把所有在线的 CPU 都当作 node 0
+        cpus = parseCpuList(readFirstLine("/sys/devices/system/cpu/online"));
+    }
+    return cpus;
+}
+
+std::vector<int> ThreadPlacement::nicQueueCpus(const std::string& interface)
+{
+    std::vector<int> cpus;
+    // 空的名字会匹配所有中断
+    if(interface.empty())
+    {
+        return cpus;
+    }
+
+    // 1. 先在 /proc/interrupts 里面按名字找，例如 eth0-TxRx-0、eth0-rx-1
+    //    只发送不接收的队列(eth0-tx-0)跳过
+    std::ifstream in("/proc/interrupts");
+    std::string line;
+    while(std::getline(in, line))
+    {
+        std::string::size_type colon = line.find(':');
+        if(colon == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string::size_type nameStart = line.find_last_of(' ');
+        std::string name = nameStart == std::string::npos ? "" : line.substr(nameStart + 1);
+        // 网卡名后面只能是分隔符或者结束，不然 eth1 会匹配到 eth10 的队列
+        if(name.compare(0, interface.size(), interface) != 0)
+        {
+            continue;
+        }
+        if(name.size() > interface.size())
+        {
+            char next = name[interface.size()];
+            if(next != '-' && next != ':' && next != '.')
+            {
+                continue;
+            }
+        }
+
+        std::string lower = toLower(name);
+        if(lower.find("tx") != std::string::npos && lower.find("rx") == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string irq = line.substr(0, colon);
+        irq.erase(0, irq.find_first_not_of(' '));
+        if(irq.empty() || !std::isdigit(static_cast<unsigned char>(irq[0])))
+        {
+            continue;
+        }
+
+        int cpu = irqCpu(std::stoi(irq));
+        if(cpu >= 0)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    if(!cpus.empty())
+    {
+        return cpus;
+    }
+
+    // 2. 有些驱动的中断名不带网卡名，退回到设备的 MSI 中断列表
+    std::string msiPath = "/sys/class/net/" + interface + "/device/msi_irqs";
+    DIR* dir = opendir(msiPath.c_str());
+    if(!dir)
+    {
+        return cpus;
+    }
+
+    std::vector<int> irqs;
+    while(struct dirent* entry = readdir(dir))
+    {
+        if(std::isdigit(static_cast<unsigned char>(entry->d_name[0])))
+        {
+            irqs.push_back(atoi(entry->d_name));
+        }
+    }
+    closedir(dir);
+
+    std::sort(irqs.begin(), irqs.end());
+    for(int irq : irqs)
+    {
+        int cpu = irqCpu(irq);
+        if(cpu >= 0)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+} // namespace http
@@ -0,0 +1,69 @@
+#include "../../include/http/VirtualHost.h"
+
+#include <muduo/base/Logging.h>
+
+namespace http
+{
+
+void VirtualHost::handle(HttpRequest& req, HttpResponse* resp)
+{
+    // 匹配到路由的时候，Router 会执行这条路由自己的中间件链
+    if(router_.route(req, resp))
+    {
+        return;
+    }
+
+    // 没有匹配的路由，还是要经过路径前缀对应的中间件(例如 CORS 的预检请求就没有路由)
+    const middleware::MiddlewareChain* chain = router_.chainFor(req.path());
+    size_t entered = 0;
+    if(!chain || chain->processBefore(req, *resp, entered))
+    {
+        LOG_INFO << "请求的URL: " << req.method() << " " << req.path();
+        LOG_INFO << "未找到路由, 返回404";
+        resp->setStatusCode(HttpResponse::k404NotFound);
+        resp->setStatusMessage("Not Found");
+        resp->setCloseConnection(true);
+    }
+
+    if(chain)
+    {
+        chain->processAfter(req, *resp, entered);
+    }
+}
+
+void VirtualHost::normalizeHost(std::string_view host, std::string& out)
+{
+    // IPv6 的地址写在方括号里面，端口在方括号后面
+    size_t end = host.size();
+    if(!host.empty() && host[0] == '[')
+    {
+        size_t bracket = host.find(']');
+        if(bracket != std::string_view::npos)
+        {
+            end = bracket + 1;
+        }
+    }
+    else
+    {
+        size_t colon = host.rfind(':');
+        if(colon != std::string_view::npos)
+        {
+            end = colon;
+        }
+    }
+
+    // 末尾的点是合法的全限定域名写法，example.com. 和 example.com 是同一个主机
+    if(end > 0 && host[end - 1] == '.')
+    {
+        --end;
+    }
+
+    out.resize(end);
+    for(size_t i = 0; i < end; ++i)
+    {
+        char c = host[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+}
+
+} // namespace http
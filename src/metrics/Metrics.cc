@@ -0,0 +1,311 @@
+#include "../../include/metrics/Metrics.h"
+
+#include <cstdio>
+
+namespace http
+{
+namespace metrics
+{
+
+namespace
+{
+
+// Prometheus 标签值里面的 \ " 和换行需要转义
+std::string escapeLabel(const std::string& value)
+{
+    std::string result;
+    result.reserve(value.size());
+    for(char c : value)
+    {
+        if(c == '\\' || c == '"')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if(c == '\n')
+        {
+            result += "\\n";
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}
+
+// 根据合并后的桶计算分位数，返回的是对应桶的上界(微秒)
+uint64_t quantile(const std::vector<uint64_t>& buckets, uint64_t count, double q)
+{
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(q * count);
+    if(target == 0)
+    {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if(seen >= target)
+        {
+            return LatencyHistogram::bucketUpperBound(i);
+        }
+    }
+    return LatencyHistogram::bucketUpperBound(buckets.size() - 1);
+}
+
+void appendSummary(std::string& out, const char* name, const std::string& labels,
+                   const std::vector<uint64_t>& buckets, uint64_t count, uint64_t sum)
+{
+    static const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    char buf[256];
+
+    for(double q : kQuantiles)
+    {
+        snprintf(buf, sizeof buf, "%s{%s%squantile=\"%g\"} %.6f\n",
+                 name, labels.c_str(), labels.empty() ? "" : ",", q,
+                 quantile(buckets, count, q) / 1e6);
+        out += buf;
+    }
+
+    const char* open = labels.empty() ? "" : "{";
+    const char* close = labels.empty() ? "" : "}";
+    snprintf(buf, sizeof buf, "%s_sum%s%s%s %.6f\n", name, open, labels.c_str(), close, sum / 1e6);
+    out += buf;
+    snprintf(buf, sizeof buf, "%s_count%s%s%s %llu\n", name, open, labels.c_str(), close,
+             static_cast<unsigned long long>(count));
+    out += buf;
+}
+
+void appendCounter(std::string& out, const char* name, const char* help, uint64_t value)
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+             name, help, name, name, static_cast<unsigned long long>(value));
+    out += buf;
+}
+
+} // namespace
+
+// ==================== LatencyHistogram ====================
+
+size_t LatencyHistogram::bucketIndex(uint64_t micros)
+{
+    if(micros < (1u << kSubBucketBits))
+    {
+        // 小于 32us 的值，一个值一个桶
+        return static_cast<size_t>(micros);
+    }
+
+    if(micros >= (uint64_t(1) << kMaxValueBits))
+    {
+        micros = (uint64_t(1) << kMaxValueBits) - 1;
+    }
+
+    // 只保留最高的 kSubBucketBits 位，剩下的位数决定落在哪一组
+    int msb = 63 - __builtin_clzll(micros);
+    int shift = msb - (kSubBucketBits - 1);
+    uint64_t sub = micros >> shift;     // 范围 [16, 32)
+    return (1u << kSubBucketBits) + (shift - 1) * kSubBucketHalf + (sub - kSubBucketHalf);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+    if(index < (1u << kSubBucketBits))
+    {
+        return index;
+    }
+
+    size_t offset = index - (1u << kSubBucketBits);
+    int shift = static_cast<int>(offset / kSubBucketHalf) + 1;
+    uint64_t sub = offset % kSubBucketHalf + kSubBucketHalf;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    buckets_[bucketIndex(micros)].add();
+    count_.add();
+    sum_.add(micros);
+}
+
+void LatencyHistogram::mergeInto(std::vector<uint64_t>& buckets, uint64_t& count, uint64_t& sum) const
+{
+    buckets.resize(kBucketCount, 0);
+    for(size_t i = 0; i < kBucketCount; ++i)
+    {
+        buckets[i] += buckets_[i].value();
+    }
+    count += count_.value();
+    sum += sum_.value();
+}
+
+// ==================== ThreadMetrics ====================
+
+ThreadMetrics::ThreadMetrics()
+{
+    for(auto& hist : routeLatency)
+    {
+        hist.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ThreadMetrics::~ThreadMetrics()
+{
+    for(auto& hist : routeLatency)
+    {
+        delete hist.load(std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram* ThreadMetrics::routeHistogram(int routeId)
+{
+    if(routeId < 0 || routeId >= kMaxRoutes)
+    {
+        return nullptr;
+    }
+
+    // 只有所属线程会写这个槽，所以这里不需要 CAS
+    LatencyHistogram* hist = routeLatency[routeId].load(std::memory_order_relaxed);
+    if(!hist)
+    {
+        hist = new LatencyHistogram();
+        routeLatency[routeId].store(hist, std::memory_order_release);
+    }
+    return hist;
+}
+
+// ==================== MetricsRegistry ====================
+
+ThreadMetrics& MetricsRegistry::local()
+{
+    // 每个线程第一次进来的时候加一次锁，之后都走 thread_local 缓存
+    thread_local ThreadMetrics* metrics = nullptr;
+    if(!metrics)
+    {
+        auto owned = std::make_unique<ThreadMetrics>();
+        metrics = owned.get();
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::move(owned));
+    }
+    return *metrics;
+}
+
+int MetricsRegistry::registerRoute(const std::string& method, const std::string& path)
+{
+    std::string label = "method=\"" + escapeLabel(method) + "\",route=\"" + escapeLabel(path) + "\"";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = routeIds_.find(label);
+    if(it != routeIds_.end())
+    {
+        return it->second;
+    }
+
+    if(routeLabels_.size() >= static_cast<size_t>(ThreadMetrics::kMaxRoutes))
+    {
+        // 超出上限的路由不再单独统计
+        return -1;
+    }
+
+    int id = static_cast<int>(routeLabels_.size());
+    routeLabels_.push_back(label);
+    routeIds_[label] = id;
+    return id;
+}
+
+std::string MetricsRegistry::renderPrometheus() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t requests = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t tlsHandshakes = 0;
+    uint64_t tlsHandshakeFailures = 0;
+    std::vector<uint64_t> statusCodes(ThreadMetrics::kMaxStatusCode, 0);
+
+    std::vector<uint64_t> latencyBuckets;
+    uint64_t latencyCount = 0;
+    uint64_t latencySum = 0;
+
+    struct RouteAggregate
+    {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+    };
+    std::vector<RouteAggregate> routes(routeLabels_.size());
+
+    for(const auto& t : threads_)
+    {
+        requests += t->requests.value();
+        bytesIn += t->bytesIn.value();
+        bytesOut += t->bytesOut.value();
+        tlsHandshakes += t->tlsHandshakes.value();
+        tlsHandshakeFailures += t->tlsHandshakeFailures.value();
+        for(int code = 0; code < ThreadMetrics::kMaxStatusCode; ++code)
+        {
+            statusCodes[code] += t->statusCodes[code].value();
+        }
+        t->requestLatency.mergeInto(latencyBuckets, latencyCount, latencySum);
+
+        for(size_t id = 0; id < routes.size(); ++id)
+        {
+            const LatencyHistogram* hist = t->routeLatency[id].load(std::memory_order_acquire);
+            if(hist)
+            {
+                hist->mergeInto(routes[id].buckets, routes[id].count, routes[id].sum);
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(4096);
+
+    appendCounter(out, "http_requests_total", "Total number of HTTP requests handled.", requests);
+
+    out += "# HELP http_responses_total Total number of HTTP responses by status code.\n";
+    out += "# TYPE http_responses_total counter\n";
+    char buf[128];
+    for(int code = 0; code < ThreadMetrics::kMaxStatusCode; ++code)
+    {
+        if(statusCodes[code] > 0)
+        {
+            snprintf(buf, sizeof buf, "http_responses_total{code=\"%d\"} %llu\n",
+                     code, static_cast<unsigned long long>(statusCodes[code]));
+            out += buf;
+        }
+    }
+
+    appendCounter(out, "http_request_bytes_total", "Total bytes of parsed HTTP requests.", bytesIn);
+    appendCounter(out, "http_response_bytes_total", "Total bytes of serialized HTTP responses.", bytesOut);
+    appendCounter(out, "tls_handshakes_total", "Total number of completed TLS handshakes.", tlsHandshakes);
+    appendCounter(out, "tls_handshake_failures_total", "Total number of failed TLS handshakes.", tlsHandshakeFailures);
+
+    out += "# HELP http_request_duration_seconds Time spent handling a request.\n";
+    out += "# TYPE http_request_duration_seconds summary\n";
+    appendSummary(out, "http_request_duration_seconds", "", latencyBuckets, latencyCount, latencySum);
+
+    out += "# HELP http_route_duration_seconds Time spent in the route handler.\n";
+    out += "# TYPE http_route_duration_seconds summary\n";
+    for(size_t id = 0; id < routes.size(); ++id)
+    {
+        if(routes[id].count > 0)
+        {
+            appendSummary(out, "http_route_duration_seconds", routeLabels_[id],
+                          routes[id].buckets, routes[id].count, routes[id].sum);
+        }
+    }
+
+    return out;
+}
+
+} // namespace metrics
+} // namespace http
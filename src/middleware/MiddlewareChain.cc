@@ -1,6 +1,9 @@
 #include "../../include/middleware/MiddlewareChain.h"
+#include "../../include/trace/Tracer.h"
 #include <muduo/base/Logging.h>
 
+#include <algorithm>
+
 namespace http
 {
 namespace middleware
@@ -11,24 +14,38 @@ void MiddlewareChain::addMiddleware(std::shared_ptr<Middleware> middleware)
     middlewares_.push_back(middleware);
 }
 
-void MiddlewareChain::processBefore(HttpRequest& request)
+bool MiddlewareChain::processBefore(HttpRequest& request, HttpResponse& response, size_t& entered) const
 {
-    for(auto& middleware : middlewares_)
+    entered = 0;
+    for(const auto& middleware : middlewares_)
     {
-        middleware->before(request);
+        trace::ScopedPhase phase(request.trace(), "middleware.before", middleware->name());
+        if(middleware->before(request, response) == Middleware::kRespond)
+        {
+            // 请求被挂起的时候这次没有响应，前面的中间件也不执行 after，等恢复之后重新处理的时候再执行
+            if(request.parked())
+            {
+                entered = 0;
+            }
+            return false;
+        }
+        ++entered;
     }
+    return true;
 }
 
-void MiddlewareChain::processAfter(HttpResponse& response)
+void MiddlewareChain::processAfter(const HttpRequest& request, HttpResponse& response, size_t entered) const
 {   
     // 反向处理响应
     try
     {
-        for(auto it = middlewares_.rbegin(); it != middlewares_.rend(); ++it)
+        for(size_t i = std::min(entered, middlewares_.size()); i > 0; --i)
         {
-            if(*it) // 空指针检查
+            const auto& middleware = middlewares_[i - 1];
+            if(middleware) // 空指针检查
             {
-                (*it)->after(response);   
+                trace::ScopedPhase phase(request.trace(), "middleware.after", middleware->name());
+                middleware->afterRequest(request, response);
             }
         }
     }
@@ -0,0 +1,363 @@
+#include "../../../include/middleware/auth/JwtMiddleware.h"
+#include "../../../include/utils/Base64Url.h"
+#include <muduo/base/Logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+#include <strings.h>
+#include <unordered_set>
+
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ecdsa.h>
+#include <openssl/hmac.h>
+#include <openssl/pem.h>
+
+namespace http
+{
+namespace middleware
+{
+
+namespace
+{
+
+std::atomic<uint64_t> nextMiddlewareId{1};
+
+// 还活着的实例的 id；有实例销毁的时候 destroyedCount 加一，
+// 每个 IO 线程下次查缓存的时候发现它变了，就把已经销毁的实例的缓存删掉
+std::mutex liveIdsMutex;
+std::unordered_set<uint64_t> liveIds;
+std::atomic<uint64_t> destroyedCount{0};
+
+const EVP_MD* digestFor(const std::string& alg)
+{
+    // HS256 / ES256 -> SHA-256，后面三位数字决定哈希算法
+    if(alg.size() != 5)
+    {
+        return nullptr;
+    }
+    std::string bits = alg.substr(2);
+    if(bits == "256") return EVP_sha256();
+    if(bits == "384") return EVP_sha384();
+    if(bits == "512") return EVP_sha512();
+    return nullptr;
+}
+
+} // namespace
+
+JwtMiddleware::JwtMiddleware(const JwtConfig& config)
+    : config_(config)
+    , ecKey_(nullptr)
+    , id_(nextMiddlewareId++)
+{
+    if(!config_.ecPublicKeyPem.empty())
+    {
+        BIO* bio = BIO_new_mem_buf(config_.ecPublicKeyPem.data(), static_cast<int>(config_.ecPublicKeyPem.size()));
+        ecKey_ = bio ? PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr) : nullptr;
+        BIO_free(bio);
+        if(!ecKey_ || EVP_PKEY_base_id(ecKey_) != EVP_PKEY_EC)
+        {
+            EVP_PKEY_free(ecKey_);
+            throw std::invalid_argument("JwtMiddleware: ecPublicKeyPem is not a valid EC public key");
+        }
+    }
+    if(config_.hmacSecret.empty() && !ecKey_)
+    {
+        throw std::invalid_argument("JwtMiddleware: neither hmacSecret nor ecPublicKeyPem is configured");
+    }
+
+    std::lock_guard<std::mutex> lock(liveIdsMutex);
+    liveIds.insert(id_);
+}
+
+JwtMiddleware::~JwtMiddleware()
+{
+    {
+        std::lock_guard<std::mutex> lock(liveIdsMutex);
+        liveIds.erase(id_);
+    }
+    destroyedCount.fetch_add(1, std::memory_order_release);
+    EVP_PKEY_free(ecKey_);
+}
+
+Middleware::Action JwtMiddleware::before(HttpRequest& request, HttpResponse& response)
+{
+    const auto& headers = request.headers();
+    auto header = headers.find("Authorization");
+    if(header == headers.end() || header->second.empty())
+    {
+        return config_.optional ? kContinue : reject(response, nullptr);
+    }
+
+    // Authorization: Bearer <token>，scheme 不区分大小写
+    const std::string& value = header->second;
+    if(value.size() <= 7 || strncasecmp(value.c_str(), "Bearer ", 7) != 0)
+    {
+        return reject(response, "invalid_request");
+    }
+    size_t start = value.find_first_not_of(' ', 7);
+    if(start == std::string::npos)
+    {
+        return reject(response, "invalid_request");
+    }
+    std::string token = value.substr(start);
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLen = 0;
+    EVP_Digest(token.data(), token.size(), digest, &digestLen, EVP_sha256(), nullptr);
+    std::string key(reinterpret_cast<const char*>(digest), digestLen);
+
+    int64_t now = static_cast<int64_t>(::time(nullptr));
+    TokenCache& cache = localCache();
+    auto it = cache.entries.find(key);
+    if(it != cache.entries.end())
+    {
+        if(now < it->second.expiresAt)
+        {
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lruIt);
+            request.setClaims(it->second.claims);
+            return kContinue;
+        }
+        // 过期了，走一遍完整的验证，它会因为 exp 被拒绝
+        cache.lru.erase(it->second.lruIt);
+        cache.entries.erase(it);
+    }
+
+    int64_t expiresAt = 0;
+    std::shared_ptr<const nlohmann::json> claims = verify(token, now, expiresAt);
+    if(!claims)
+    {
+        return reject(response, "invalid_token");
+    }
+
+    if(config_.cacheSize > 0)
+    {
+        cache.lru.push_front(key);
+        CacheEntry& entry = cache.entries[key];
+        entry.claims = claims;
+        entry.expiresAt = expiresAt;
+        entry.lruIt = cache.lru.begin();
+        while(cache.entries.size() > config_.cacheSize)
+        {
+            cache.entries.erase(cache.lru.back());
+            cache.lru.pop_back();
+        }
+    }
+
+    request.setClaims(std::move(claims));
+    return kContinue;
+}
+
+void JwtMiddleware::after(HttpResponse& /* response */)
+{
+}
+
+JwtMiddleware::TokenCache& JwtMiddleware::localCache() const
+{
+    // 一个 IO 线程上可能有好几个认证中间件(不同路径前缀用不同的密钥)，按实例的 id 区分，
+    // 用 id 而不是 this 指针，避免实例销毁之后新实例复用同一个地址，拿到别的密钥验证过的结果
+    thread_local std::unordered_map<uint64_t, TokenCache> caches;
+    // 实例销毁的时候没办法去清理每个 IO 线程的缓存，由各个线程自己在这里发现并清掉
+    thread_local uint64_t seenDestroyed = 0;
+    uint64_t destroyed = destroyedCount.load(std::memory_order_acquire);
+    if(destroyed != seenDestroyed)
+    {
+        seenDestroyed = destroyed;
+        std::lock_guard<std::mutex> lock(liveIdsMutex);
+        for(auto it = caches.begin(); it != caches.end(); )
+        {
+            it = liveIds.count(it->first) ? std::next(it) : caches.erase(it);
+        }
+    }
+    return caches[id_];
+}
+
+std::shared_ptr<const nlohmann::json> JwtMiddleware::verify(const std::string& token, int64_t now, int64_t& expiresAt) const
+{
+    // header.payload.signature
+    size_t dot1 = token.find('.');
+    size_t dot2 = dot1 == std::string::npos ? std::string::npos : token.find('.', dot1 + 1);
+    if(dot2 == std::string::npos || token.find('.', dot2 + 1) != std::string::npos)
+    {
+        return nullptr;
+    }
+
+    std::string headerText, payloadText, signature;
+    if(!Base64Url::decode(token.data(), dot1, headerText)
+       || !Base64Url::decode(token.data() + dot1 + 1, dot2 - dot1 - 1, payloadText)
+       || !Base64Url::decode(token.data() + dot2 + 1, token.size() - dot2 - 1, signature))
+    {
+        return nullptr;
+    }
+
+    nlohmann::json header = nlohmann::json::parse(headerText, nullptr, false);
+    if(!header.is_object() || !header.contains("alg") || !header["alg"].is_string())
+    {
+        return nullptr;
+    }
+
+    // 先验证签名再解析 payload，没有签名的内容不值得花时间解析
+    if(!verifySignature(header["alg"].get<std::string>(), token.substr(0, dot2), signature))
+    {
+        LOG_DEBUG << "JwtMiddleware: signature verification failed";
+        return nullptr;
+    }
+
+    auto claims = std::make_shared<nlohmann::json>(nlohmann::json::parse(payloadText, nullptr, false));
+    if(!claims->is_object() || !checkClaims(*claims, now))
+    {
+        return nullptr;
+    }
+
+    expiresAt = now + config_.maxCacheSeconds;
+    auto exp = claims->find("exp");
+    if(exp != claims->end())
+    {
+        expiresAt = std::min(expiresAt, exp->get<int64_t>() + config_.leewaySeconds);
+    }
+    return claims;
+}
+
+bool JwtMiddleware::verifySignature(const std::string& alg, const std::string& signingInput, const std::string& signature) const
+{
+    const EVP_MD* md = digestFor(alg);
+    if(!md)
+    {
+        return false;
+    }
+
+    if(alg[0] == 'H' && alg[1] == 'S')
+    {
+        if(config_.hmacSecret.empty())
+        {
+            return false;
+        }
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int macLen = 0;
+        if(!HMAC(md, config_.hmacSecret.data(), static_cast<int>(config_.hmacSecret.size()),
+                 reinterpret_cast<const unsigned char*>(signingInput.data()), signingInput.size(), mac, &macLen))
+        {
+            return false;
+        }
+        // 常数时间比较，不能让比较的耗时泄露签名的前缀
+        return signature.size() == macLen && CRYPTO_memcmp(signature.data(), mac, macLen) == 0;
+    }
+
+    if(alg[0] == 'E' && alg[1] == 'S')
+    {
+        // JWS 里面的 ECDSA 签名是定长的 R || S，OpenSSL 要的是 DER 编码，需要转换一下
+        size_t half = alg == "ES256" ? 32 : alg == "ES384" ? 48 : 66;
+        if(!ecKey_ || signature.size() != half * 2)
+        {
+            return false;
+        }
+        const unsigned char* raw = reinterpret_cast<const unsigned char*>(signature.data());
+        ECDSA_SIG* sig = ECDSA_SIG_new();
+        BIGNUM* r = BN_bin2bn(raw, static_cast<int>(half), nullptr);
+        BIGNUM* s = BN_bin2bn(raw + half, static_cast<int>(half), nullptr);
+        if(!sig || !r || !s || !ECDSA_SIG_set0(sig, r, s))
+        {
+            BN_free(r);
+            BN_free(s);
+            ECDSA_SIG_free(sig);
+            return false;
+        }
+        unsigned char* der = nullptr;
+        int derLen = i2d_ECDSA_SIG(sig, &der);
+        ECDSA_SIG_free(sig);
+        if(derLen <= 0)
+        {
+            return false;
+        }
+
+        bool ok = false;
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        if(ctx && EVP_DigestVerifyInit(ctx, nullptr, md, nullptr, ecKey_) == 1)
+        {
+            ok = EVP_DigestVerify(ctx, der, derLen,
+                                  reinterpret_cast<const unsigned char*>(signingInput.data()), signingInput.size()) == 1;
+        }
+        EVP_MD_CTX_free(ctx);
+        OPENSSL_free(der);
+        return ok;
+    }
+
+    // none 以及其它不支持的算法
+    return false;
+}
+
+bool JwtMiddleware::checkClaims(const nlohmann::json& claims, int64_t now) const
+{
+    auto exp = claims.find("exp");
+    if(exp != claims.end() && (!exp->is_number() || now >= exp->get<int64_t>() + config_.leewaySeconds))
+    {
+        return false;
+    }
+
+    auto nbf = claims.find("nbf");
+    if(nbf != claims.end() && (!nbf->is_number() || now + config_.leewaySeconds < nbf->get<int64_t>()))
+    {
+        return false;
+    }
+
+    if(!config_.issuer.empty())
+    {
+        auto iss = claims.find("iss");
+        if(iss == claims.end() || !iss->is_string() || iss->get_ref<const std::string&>() != config_.issuer)
+        {
+            return false;
+        }
+    }
+
+    if(!config_.audience.empty())
+    {
+        // aud 可以是一个字符串，也可以是字符串数组
+        auto aud = claims.find("aud");
+        if(aud == claims.end())
+        {
+            return false;
+        }
+        bool matched = false;
+        if(aud->is_string())
+        {
+            matched = aud->get_ref<const std::string&>() == config_.audience;
+        }
+        else if(aud->is_array())
+        {
+            for(const auto& item : *aud)
+            {
+                matched = matched || (item.is_string() && item.get_ref<const std::string&>() == config_.audience);
+            }
+        }
+        if(!matched)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Middleware::Action JwtMiddleware::reject(HttpResponse& response, const char* error)
+{
+    response.setStatusCode(HttpResponse::k401Unauthorized);
+    response.setStatusMessage("Unauthorized");
+    // 没有带 token 的时候只告诉客户端要用 Bearer 认证，带了但是不对的时候说明原因(RFC 6750)
+    std::string challenge = "Bearer";
+    if(error)
+    {
+        challenge += " error=\"";
+        challenge += error;
+        challenge += "\"";
+    }
+    response.addHeader("WWW-Authenticate", challenge);
+    response.setContentType("text/plain");
+    response.setBody("Unauthorized");
+    return kRespond;
+}
+
+} // namespace middleware
+} // namespace http
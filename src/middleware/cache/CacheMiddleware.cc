@@ -0,0 +1,338 @@
+#include "../../../include/middleware/cache/CacheMiddleware.h"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+
+#include <functional>
+#include <strings.h>
+
+namespace http
+{
+namespace middleware
+{
+
+CacheMiddleware::CacheMiddleware(const CacheConfig& config)
+    : config_(config)
+{}
+
+Middleware::Action CacheMiddleware::before(HttpRequest& request, HttpResponse& response)
+{
+    const CacheRule* rule = findRule(request);
+    if(!rule)
+    {
+        return kContinue;
+    }
+
+    std::string key = makeKey(request, *rule);
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Clock::time_point now = Clock::now();
+
+    auto it = shard.entries.find(key);
+    if(it == shard.entries.end())
+    {
+        // 第一次请求这个 key，由当前请求去执行处理器
+        Waiters evicted;
+        claim(insertEntry(shard, key, evicted), now);
+        lock.unlock();
+        resumeAll(evicted);
+        return kContinue;
+    }
+
+    Entry& entry = it->second;
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruIt);
+    bool canRefresh = !entry.refreshing || now >= entry.leaseUntil;
+
+    if(entry.response && now < entry.freshUntil)
+    {
+        std::shared_ptr<const CachedResponse> cached = entry.response;
+        lock.unlock();
+        return serve(*cached, response);
+    }
+
+    if(entry.response && now < entry.staleUntil)
+    {
+        // stale-while-revalidate：只让一个请求去刷新，其它请求直接返回旧的响应
+        if(canRefresh)
+        {
+            claim(entry, now);
+            return kContinue;
+        }
+        std::shared_ptr<const CachedResponse> cached = entry.response;
+        lock.unlock();
+        return serve(*cached, response);
+    }
+
+    if(canRefresh)
+    {
+        claim(entry, now);
+        return kContinue;
+    }
+
+    // 已经有请求在执行处理器了，又没有可以返回的响应：不能在 IO 线程上等它的结果，
+    // 那样会卡住这个 EventLoop 上的所有连接，把请求挂起来，拿到刷新权的请求结束的时候恢复它，
+    // 恢复之后重新走一遍 before，一般就直接命中了
+    muduo::net::EventLoop* loop = muduo::net::EventLoop::getEventLoopOfCurrentThread();
+    std::shared_ptr<ParkedRequest> parked;
+    if(!request.resumed() && loop && (parked = request.park()))
+    {
+        entry.waiters.push_back(parked);
+        lock.unlock();
+        // 拿到刷新权的请求一直没有结果的时候，最多等 coalesceTimeoutMs
+        std::weak_ptr<ParkedRequest> weak(parked);
+        loop->runAfter(config_.coalesceTimeoutMs / 1000.0, [weak] {
+            if(auto parked = weak.lock())
+            {
+                parked->resume();
+            }
+        });
+        return kRespond;
+    }
+
+    // 不能挂起(已经挂起过一次，或者不是从 HttpServer 来的请求)：有过期的响应就返回它，比重复执行处理器好
+    if(entry.response)
+    {
+        std::shared_ptr<const CachedResponse> cached = entry.response;
+        lock.unlock();
+        return serve(*cached, response);
+    }
+    lock.unlock();
+    LOG_DEBUG << "CacheMiddleware: refresh in progress and nothing cached, running handler, key=" << key;
+    return kContinue;
+}
+
+void CacheMiddleware::after(HttpResponse& /* response */)
+{
+    // 需要请求才能算出 key，所有工作都在 afterRequest 里面做
+}
+
+void CacheMiddleware::afterRequest(const HttpRequest& request, HttpResponse& response)
+{
+    const CacheRule* rule = findRule(request);
+    if(!rule)
+    {
+        return;
+    }
+
+    if(!rule->varyHeaders.empty() && response.headers().find("Vary") == response.headers().end())
+    {
+        std::string vary;
+        for(const auto& header : rule->varyHeaders)
+        {
+            if(!vary.empty())
+            {
+                vary += ", ";
+            }
+            vary += header;
+        }
+        response.addHeader("Vary", vary);
+    }
+
+    // 只缓存 200，带 Set-Cookie 的响应是给某一个用户的，不能缓存；
+    // 响应自己的 Vary 里面有不在缓存 key 里面的请求头(例如 CORS 的 Vary: Origin)，说明响应随那个请求头变化，
+    // 缓存下来会把一个请求的响应发给另一个请求，也不能缓存
+    std::shared_ptr<CachedResponse> cached;
+    if(response.getStatusCode() == HttpResponse::k200Ok
+       && response.headers().find("Set-Cookie") == response.headers().end()
+       && varyCoveredByKey(response, *rule))
+    {
+        auto bytes = std::make_shared<const std::string>(response.renderHeadersAndBody());
+        if(bytes->size() <= config_.maxResponseSize)
+        {
+            cached = std::make_shared<CachedResponse>();
+            cached->statusCode = response.getStatusCode();
+            cached->statusMessage = response.getStatusMessage();
+            cached->bytes = std::move(bytes);
+        }
+    }
+
+    std::string key = makeKey(request, *rule);
+    Shard& shard = shardFor(key);
+    Waiters waiters;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if(cached)
+        {
+            Entry& entry = it != shard.entries.end() ? it->second : insertEntry(shard, key, waiters);
+            Clock::time_point now = Clock::now();
+            entry.response = std::move(cached);
+            entry.freshUntil = now + std::chrono::milliseconds(rule->ttlMs);
+            entry.staleUntil = entry.freshUntil + std::chrono::milliseconds(rule->staleWhileRevalidateMs);
+            entry.refreshing = false;
+            waiters.insert(waiters.end(), entry.waiters.begin(), entry.waiters.end());
+            entry.waiters.clear();
+            evictIfNeeded(shard, waiters);
+        }
+        else if(it != shard.entries.end())
+        {
+            // 这次不能缓存，放开刷新权，等待的请求恢复之后会自己去执行处理器
+            it->second.refreshing = false;
+            waiters = std::move(it->second.waiters);
+            if(!it->second.response)
+            {
+                shard.lru.erase(it->second.lruIt);
+                shard.entries.erase(it);
+            }
+        }
+    }
+
+    resumeAll(waiters);
+}
+
+bool CacheMiddleware::varyCoveredByKey(const HttpResponse& response, const CacheRule& rule)
+{
+    auto vary = response.headers().find("Vary");
+    if(vary == response.headers().end())
+    {
+        return true;
+    }
+
+    const std::string& value = vary->second;
+    size_t pos = 0;
+    while(pos < value.size())
+    {
+        size_t end = value.find(',', pos);
+        if(end == std::string::npos)
+        {
+            end = value.size();
+        }
+        size_t begin = value.find_first_not_of(" \t", pos);
+        size_t last = value.find_last_not_of(" \t", end - 1);
+        pos = end + 1;
+        if(begin == std::string::npos || begin >= end)
+        {
+            continue;
+        }
+
+        // 请求头的名字不区分大小写；Vary: * 表示随所有东西变化，不能缓存
+        std::string name = value.substr(begin, last - begin + 1);
+        bool covered = false;
+        for(const auto& header : rule.varyHeaders)
+        {
+            covered = covered || strcasecmp(header.c_str(), name.c_str()) == 0;
+        }
+        if(!covered)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const CacheRule* CacheMiddleware::findRule(const HttpRequest& request) const
+{
+    if(request.method() != HttpRequest::kGet && request.method() != HttpRequest::kHead)
+    {
+        return nullptr;
+    }
+
+    auto it = config_.routes.find(request.path());
+    if(it == config_.routes.end())
+    {
+        return nullptr;
+    }
+
+    // 带 Authorization 的请求一般是某个用户自己的数据，除非路由明确按它区分缓存
+    const CacheRule& rule = it->second;
+    if(!request.getHeader("Authorization").empty())
+    {
+        bool varyOnAuth = false;
+        for(const auto& header : rule.varyHeaders)
+        {
+            varyOnAuth = varyOnAuth || strcasecmp(header.c_str(), "Authorization") == 0;
+        }
+        if(!varyOnAuth)
+        {
+            return nullptr;
+        }
+    }
+    return &rule;
+}
+
+std::string CacheMiddleware::makeKey(const HttpRequest& request, const CacheRule& rule)
+{
+    std::string key = HttpRequest::methodString(request.method());
+    key += ' ';
+    key += request.path();
+    key += '?';
+    key += request.query();
+    for(const auto& header : rule.varyHeaders)
+    {
+        key += '\n';
+        key += headerValue(request, header);
+    }
+    return key;
+}
+
+const std::string& CacheMiddleware::headerValue(const HttpRequest& request, const std::string& name)
+{
+    // 请求头按收到的原样保存，配置里面的名字大小写可能不一样
+    static const std::string empty;
+    const auto& headers = request.headers();
+    auto it = headers.find(name);
+    if(it != headers.end())
+    {
+        return it->second;
+    }
+    for(const auto& header : headers)
+    {
+        if(strcasecmp(header.first.c_str(), name.c_str()) == 0)
+        {
+            return header.second;
+        }
+    }
+    return empty;
+}
+
+CacheMiddleware::Shard& CacheMiddleware::shardFor(const std::string& key)
+{
+    return shards_[std::hash<std::string>()(key) % kShardCount];
+}
+
+CacheMiddleware::Entry& CacheMiddleware::insertEntry(Shard& shard, const std::string& key, Waiters& evicted)
+{
+    shard.lru.push_front(key);
+    Entry& entry = shard.entries[key];
+    entry.lruIt = shard.lru.begin();
+    evictIfNeeded(shard, evicted);
+    return entry;
+}
+
+void CacheMiddleware::evictIfNeeded(Shard& shard, Waiters& waiters)
+{
+    size_t limit = config_.maxEntries / kShardCount + 1;
+    while(shard.entries.size() > limit)
+    {
+        // 最后一个是最久没有用过的，刚插入的在最前面，不会被淘汰掉
+        auto it = shard.entries.find(shard.lru.back());
+        waiters.insert(waiters.end(), it->second.waiters.begin(), it->second.waiters.end());
+        shard.entries.erase(it);
+        shard.lru.pop_back();
+    }
+}
+
+void CacheMiddleware::resumeAll(const Waiters& waiters)
+{
+    // resume 会拿 EventLoop 的锁，放到分片锁外面调用
+    for(const auto& waiter : waiters)
+    {
+        waiter->resume();
+    }
+}
+
+void CacheMiddleware::claim(Entry& entry, Clock::time_point now) const
+{
+    entry.refreshing = true;
+    entry.leaseUntil = now + std::chrono::milliseconds(config_.coalesceTimeoutMs);
+}
+
+Middleware::Action CacheMiddleware::serve(const CachedResponse& cached, HttpResponse& response)
+{
+    response.setStatusCode(cached.statusCode);
+    response.setStatusMessage(cached.statusMessage);
+    response.setPrerendered(cached.bytes);
+    return kRespond;
+}
+
+} // namespace middleware
+} // namespace http
@@ -1,8 +1,5 @@
 #include "../../../include/middleware/cors/CorsMiddleware.h"
 #include <muduo/base/Logging.h>
-#include <algorithm>
-// #include <iostream>
-#include <sstream>
 
 namespace http
 {
@@ -10,10 +7,10 @@ namespace middleware
 {
     
 CorsMiddleware::CorsMiddleware(const CorsConfig& config)
-    : config_(config)
+    : policy_(config)
 {}
 
-void CorsMiddleware::before(HttpRequest& request)
+Middleware::Action CorsMiddleware::before(HttpRequest& request, HttpResponse& response)
 {
     LOG_DEBUG << "CorsMiddleware::before - Processing request";
 
@@ -22,106 +19,84 @@ void CorsMiddleware::before(HttpRequest& request)
         // 浏览器在发送复杂请求的时候，会发送这个预检请求
         // 只有服务器同意了，才回发送实际的请求
         LOG_INFO << "Processing CORS preflight request";
-        HttpResponse response;
         handlePreflightRequest(request, response);
-        throw response; // 这里很关键，我这里throw之后，说明我这个请求不需要再传给下一个中间件
-        // 不需要再进去Router查找路由了，不需要执行业务逻辑，我直接把结果发回浏览器即可，这是一个非常高效的处理方式
+        return kRespond; // 这里很关键，返回 kRespond 说明我这个请求不需要再传给下一个中间件
+        // 不需要再进去Router查找路由了，不需要执行业务逻辑，我直接把结果发回浏览器即可，而且不走异常，代价和普通请求差不多
     }
+    return kContinue;
 }
 
-void CorsMiddleware::after(HttpResponse& response)
+void CorsMiddleware::after(HttpResponse& /* response */)
 {
-    // 实际上，服务器不管是什么类型的请求，这里都要加上这个headers，否则会让浏览器认为：虽然刚刚的options答应了给权限
-    // 但是你现在返回给我的数据里写我没有权读取，那么浏览器会拦截这个响应数据，前端代码依然拿不到数据，最后报错
-    LOG_DEBUG << "CorsMiddleware::after - Processing response";
-
-    // 直接添加CORS头，简化处理逻辑
-    if(!config_.allowedOrigins.empty())
-    {
-        // 如果允许所有的源
-        if(std::find(config_.allowedOrigins.begin(), config_.allowedOrigins.end(), "*") 
-                != config_.allowedOrigins.end())
-        {
-            addCorsHeaders(response, "*");
-        }
-        else
-        {
-            // 添加第一个允许的源
-            addCorsHeaders(response, config_.allowedOrigins[0]);
-        }
-    }
+    // 要看请求的 Origin 才知道怎么设置响应头，所有工作都在 afterRequest 里面做
 }
 
-bool CorsMiddleware::isOriginAllowed(const std::string& origin) const
+void CorsMiddleware::afterRequest(const HttpRequest& request, HttpResponse& response)
 {
-    // 在vector里面查找的逻辑
-    // 如果白名单是空的，通常意味着没有设置防， 没有限制
-    // 否则先看看有没有通配符
-    // 最后再查找origin是不是在白名单里面
-    return config_.allowedOrigins.empty() 
-            || std::find(config_.allowedOrigins.begin(), config_.allowedOrigins.end(), "*") != config_.allowedOrigins.end()
-            || std::find(config_.allowedOrigins.begin(), config_.allowedOrigins.end(), origin) != config_.allowedOrigins.end();
+    // 实际上，服务器不管是什么类型的请求，这里都要加上这个headers，否则会让浏览器认为：虽然刚刚的options答应了给权限
+    // 但是你现在返回给我的数据里写我没有权读取，那么浏览器会拦截这个响应数据，前端代码依然拿不到数据，最后报错
+    // Allow-Methods / Allow-Headers / Max-Age 只有预检响应需要，普通响应只设置 origin 相关的头
+    LOG_DEBUG << "CorsMiddleware::after - Processing response";
+    addOriginHeaders(request.getHeader("Origin"), response);
 }
 
 void CorsMiddleware::handlePreflightRequest(const HttpRequest& request, HttpResponse& response)
 {
-    const std::string& origin = request.getHeader("Origin");
-
-    if(!isOriginAllowed(origin))
+    if(!addOriginHeaders(request.getHeader("Origin"), response))
     {
-        LOG_WARN << "Origin not allowed: " << origin;
+        LOG_WARN << "Origin not allowed: " << request.getHeader("Origin");
         response.setStatusCode(HttpResponse::k403Forbidden);
         return;
     }
 
     // 如果允许，我们需要返回一个response，给这个response加上这个头
     // 并且这个 Option请求是没有body内容的，所以我们返回 204
-    addCorsHeaders(response, origin);
+    if(!policy_.allowMethods().empty())
+    {
+        response.addHeader("Access-Control-Allow-Methods", policy_.allowMethods());
+    }
+    if(!policy_.allowHeaders().empty())
+    {
+        response.addHeader("Access-Control-Allow-Headers", policy_.allowHeaders());
+    }
+    response.addHeader("Access-Control-Max-Age", policy_.maxAge());
     response.setStatusCode(HttpResponse::k204NoContent);
     LOG_INFO << "Preflight request processed successfully";
 }
 
-void CorsMiddleware::addCorsHeaders(HttpResponse& response, const std::string& origin)
+bool CorsMiddleware::addOriginHeaders(const std::string& origin, HttpResponse& response)
 {
-    try
+    // 允许所有 origin 又不带凭证，响应和 origin 无关
+    if(policy_.allowAllOrigins() && !policy_.allowCredentials())
     {
-        response.addHeader("Access-Control-Allow-Origin", origin);
-
-        if(config_.allowCredentials)
-        {
-            response.addHeader("Access-Control-Allow-Credentials", "true");
-        }
-
-        if(!config_.allowedMethods.empty())
-        {
-            response.addHeader("Access-Control-Allow-Methods", join(config_.allowedMethods, ", "));
-        }
-
-        if(!config_.allowedHeaders.empty())
-        {
-            response.addHeader("Access-Control-Allow-Headers", join(config_.allowedHeaders, ", "));
-        }        
-
-        response.addHeader("Access-Control-Max-Age", std::to_string(config_.maxAge));
+        response.addHeader("Access-Control-Allow-Origin", "*");
+        return true;
+    }
 
-        LOG_DEBUG << "CORS headers added successfully";
+    // 其它情况下响应的内容取决于 Origin，告诉缓存按 Origin 区分
+    const auto& headers = response.headers();
+    auto vary = headers.find("Vary");
+    if(vary == headers.end())
+    {
+        response.addHeader("Vary", "Origin");
     }
-    catch(const std::exception& e)
+    else if(vary->second.find("Origin") == std::string::npos)
     {
-        LOG_ERROR << "Error adding CORS heads: " << e.what();
+        response.addHeader("Vary", vary->second + ", Origin");
     }
-}
 
-// 工具函数，将字符串数组拼接成单个字符串
-std::string CorsMiddleware::join(const std::vector<std::string>& strings, const std::string& delimiter)
-{
-    std::ostringstream result;
-    for(size_t i=0; i<strings.size(); ++i)
+    if(origin.empty() || !policy_.isOriginAllowed(origin))
+    {
+        return false;
+    }
+
+    // 带凭证的时候规范不允许返回 *，只能回显具体的 origin
+    response.addHeader("Access-Control-Allow-Origin", origin);
+    if(policy_.allowCredentials())
     {
-        if(i > 0) result << delimiter;
-        result << strings[i]; 
+        response.addHeader("Access-Control-Allow-Credentials", "true");
     }
-    return result.str();
+    return true;
 }
 
 } // namespace middleware
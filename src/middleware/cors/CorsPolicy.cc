@@ -0,0 +1,102 @@
+#include "../../../include/middleware/cors/CorsPolicy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace http
+{
+namespace middleware
+{
+
+CorsPolicy::CorsPolicy(const CorsConfig& config)
+    : allowAll_(config.allowedOrigins.empty())
+    , allowCredentials_(config.allowCredentials)
+    , allowMethods_(join(config.allowedMethods))
+    , allowHeaders_(join(config.allowedHeaders))
+    , maxAge_(std::to_string(config.maxAge))
+{
+    for(const auto& origin : config.allowedOrigins)
+    {
+        if(origin == "*")
+        {
+            allowAll_ = true;
+            continue;
+        }
+
+        std::string lower = toLower(origin);
+        size_t star = lower.find('*');
+        if(star == std::string::npos)
+        {
+            exactOrigins_.insert(lower);
+        }
+        else
+        {
+            // https://*.example.com -> ("https://", ".example.com")
+            wildcardOrigins_.emplace_back(lower.substr(0, star), lower.substr(star + 1));
+        }
+    }
+
+    // 允许所有 origin 又带凭证，等于回显任何网站的 Origin 并且允许带 cookie 读取响应，任何网站都能读用户的数据
+    if(allowAll_ && allowCredentials_)
+    {
+        throw std::invalid_argument("CorsPolicy: allowCredentials requires an explicit list of allowed origins, not \"*\"");
+    }
+}
+
+bool CorsPolicy::isOriginAllowed(const std::string& origin) const
+{
+    if(allowAll_)
+    {
+        return true;
+    }
+    if(origin.empty())
+    {
+        return false;
+    }
+
+    // 每个 IO 线程复用同一块内存
+    thread_local std::string lower;
+    lower.resize(origin.size());
+    std::transform(origin.begin(), origin.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); });
+
+    if(exactOrigins_.count(lower))
+    {
+        return true;
+    }
+
+    for(const auto& [prefix, suffix] : wildcardOrigins_)
+    {
+        // * 至少要匹配一个字符，并且不能跨过 / (origin 里面不会有路径)
+        if(lower.size() > prefix.size() + suffix.size()
+           && lower.compare(0, prefix.size(), prefix) == 0
+           && lower.compare(lower.size() - suffix.size(), suffix.size(), suffix) == 0
+           && lower.find('/', prefix.size()) >= lower.size() - suffix.size())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string CorsPolicy::toLower(const std::string& s)
+{
+    std::string result(s);
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); });
+    return result;
+}
+
+std::string CorsPolicy::join(const std::vector<std::string>& strings)
+{
+    std::string result;
+    for(size_t i = 0; i < strings.size(); ++i)
+    {
+        if(i > 0) result += ", ";
+        result += strings[i];
+    }
+    return result;
+}
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,147 @@
+#include "../../../include/middleware/ratelimit/RateLimitMiddleware.h"
+#include <muduo/base/Logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace http
+{
+namespace middleware
+{
+
+RateLimitMiddleware::RateLimitMiddleware(const RateLimitConfig& config)
+    : config_(config)
+{}
+
+Middleware::Action RateLimitMiddleware::before(HttpRequest& request, HttpResponse& response)
+{
+    // 挂起之后恢复的请求第一次进来的时候已经计过数了
+    if(request.resumed())
+    {
+        return kContinue;
+    }
+
+    // 每个 IO 线程复用同一块内存拼 key
+    thread_local std::string key;
+    makeKey(request, key);
+
+    int retryAfter = acquire(key);
+    if(retryAfter == 0)
+    {
+        return kContinue;
+    }
+
+    LOG_DEBUG << "RateLimitMiddleware: too many requests, key=" << key;
+    countRejected();
+    response.setStatusCode(HttpResponse::k429TooManyRequests);
+    response.setStatusMessage("Too Many Requests");
+    response.addHeader("Retry-After", std::to_string(retryAfter));
+    response.setContentType("text/plain");
+    response.setBody("Too Many Requests");
+    return kRespond;
+}
+
+void RateLimitMiddleware::after(HttpResponse& /* response */)
+{
+}
+
+void RateLimitMiddleware::countRejected()
+{
+    // 被刷的时候每个请求一条 WARN 会把日志打爆，这里只汇总
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+    int64_t last = lastWarnMs_.load(std::memory_order_relaxed);
+    if(last != 0 && now - last < kWarnIntervalMs)
+    {
+        return;
+    }
+    // 多个线程同时到期的时候只有一个打日志
+    if(!lastWarnMs_.compare_exchange_strong(last, now, std::memory_order_relaxed))
+    {
+        return;
+    }
+    LOG_WARN << "RateLimitMiddleware: rejected " << rejected_.exchange(0, std::memory_order_relaxed)
+             << " requests since the last report";
+}
+
+void RateLimitMiddleware::makeKey(const HttpRequest& request, std::string& key) const
+{
+    // 加上前缀，避免某个 API key 的值刚好和另一个客户端的 IP 一样
+    if(config_.keyType == RateLimitConfig::kHeader)
+    {
+        const auto& headers = request.headers();
+        auto it = headers.find(config_.keyName);
+        if(it != headers.end() && !it->second.empty())
+        {
+            key.assign("h:");
+            key += it->second;
+            return;
+        }
+    }
+    else if(config_.keyType == RateLimitConfig::kCookie)
+    {
+        std::string_view value;
+        if(request.getCookie(config_.keyName, value) && !value.empty())
+        {
+            key.assign("c:");
+            key += value;
+            return;
+        }
+    }
+
+    key.assign("ip:");
+    key += request.peerIp();
+}
+
+int RateLimitMiddleware::acquire(const std::string& key)
+{
+    Shard& shard = shards_[std::hash<std::string>()(key) % kShardCount];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // 拿到锁之后再读时间，不然抢锁失败的线程拿着更早的时间进来，算出来的间隔是负的，会扣掉令牌
+    Clock::time_point now = Clock::now();
+    auto it = shard.buckets.find(key);
+    if(it == shard.buckets.end())
+    {
+        // 新的客户端拿到一个满的桶，这次请求消耗一个令牌
+        shard.lru.push_front(key);
+        Bucket& bucket = shard.buckets[key];
+        bucket.tokens = config_.burst - 1;
+        bucket.lastRefill = now;
+        bucket.lruIt = shard.lru.begin();
+
+        size_t limit = config_.maxClients / kShardCount + 1;
+        while(shard.buckets.size() > limit)
+        {
+            // 被淘汰的客户端下次再来的时候又是一个满的桶，所以上限不能设得太小
+            shard.buckets.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+        return config_.burst >= 1 ? 0 : 1;
+    }
+
+    Bucket& bucket = it->second;
+    shard.lru.splice(shard.lru.begin(), shard.lru, bucket.lruIt);
+
+    // 按距离上次补充的时间补充令牌，最多补满
+    double elapsed = std::chrono::duration<double>(now - bucket.lastRefill).count();
+    bucket.tokens = std::min(config_.burst, bucket.tokens + elapsed * config_.ratePerSecond);
+    bucket.lastRefill = now;
+
+    if(bucket.tokens >= 1)
+    {
+        bucket.tokens -= 1;
+        return 0;
+    }
+
+    // 攒够一个令牌需要的时间，Retry-After 只能是整数秒，向上取整
+    if(config_.ratePerSecond <= 0)
+    {
+        return 3600;
+    }
+    return std::max(1, static_cast<int>(std::ceil((1 - bucket.tokens) / config_.ratePerSecond)));
+}
+
+} // namespace middleware
+} // namespace http
@@ -0,0 +1,49 @@
+#include "../../../include/middleware/tracing/TracingMiddleware.h"
+
+#include <random>
+
+namespace http
+{
+namespace middleware
+{
+
+TracingMiddleware::TracingMiddleware(const trace::TraceConfig& config)
+{
+    trace::Tracer::getInstance().start(config);
+}
+
+Middleware::Action TracingMiddleware::before(HttpRequest& request, HttpResponse& /* response */)
+{
+    trace::RequestTrace* trace = request.trace();
+    if(!trace)
+    {
+        return kContinue;
+    }
+
+    // 请求头的 key 是区分大小写保存的，规范里面写的是小写，有些客户端会首字母大写
+    const auto& headers = request.headers();
+    auto header = headers.find("traceparent");
+    if(header == headers.end())
+    {
+        header = headers.find("Traceparent");
+    }
+    bool sampled = false;
+    if(header == headers.end() || !trace->parseTraceparent(header->second, sampled))
+    {
+        // 没有上游或者上游的格式不对，开始一个新的 trace
+        thread_local std::mt19937 rng(std::random_device{}());
+        trace->startNewTrace();
+        sampled = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < trace::Tracer::getInstance().sampleRatio();
+    }
+
+    trace->sampled = sampled;
+    trace->recording = sampled;
+    return kContinue;
+}
+
+void TracingMiddleware::after(HttpResponse& /* response */)
+{
+}
+
+} // namespace middleware
+} // namespace http
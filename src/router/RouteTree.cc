@@ -0,0 +1,419 @@
+#include "../../include/router/RouteTree.h"
+
+#include <bitset>
+#include <limits>
+#include <stdexcept>
+
+namespace http
+{
+namespace router
+{
+
+// 参数的类型限制，spec 是花括号里面冒号后面的原文，两个参数 spec 相同就是同一种类型
+struct RouteTree::Constraint
+{
+    ParamType           type = kString;
+    std::string         spec;
+    bool                charClass = false;      // spec 是 [...]+ 这种字符集合
+    std::bitset<256>    chars;                  // 字符集合里面允许出现的字符
+};
+
+struct RouteTree::Node
+{
+    std::string                         prefix;         // 压缩后的静态前缀
+    std::string                         indices;        // 每个静态子节点前缀的第一个字符，和 children 一一对应
+    std::vector<std::unique_ptr<Node>>  children;       // 静态子节点
+    std::vector<std::unique_ptr<Node>>  paramChildren;  // :name 和 {name:类型}，匹配一个路径段，带类型的在前面
+    std::unique_ptr<Node>               wildcardChild;  // *name，匹配剩下的全部路径
+    std::string                         name;           // 参数节点/通配符节点的参数名
+    Constraint                          constraint;     // 参数节点的类型限制
+    int                                 value = -1;     // 路由编号，-1 表示这里没有路由结束
+};
+
+RouteTree::RouteTree()
+    : root_(std::make_unique<Node>())
+{}
+
+RouteTree::~RouteTree() = default;
+RouteTree::RouteTree(RouteTree&&) noexcept = default;
+RouteTree& RouteTree::operator=(RouteTree&&) noexcept = default;
+
+void RouteTree::insert(const std::string& pattern, int value, bool literal)
+{
+    Node* node = root_.get();
+    size_t pos = 0;
+
+    while(pos < pattern.size())
+    {
+        // 找到下一个参数或者通配符的开始位置，它们必须紧跟在 / 后面
+        size_t special = std::string::npos;
+        if(!literal)
+        {
+            for(size_t i = pos; i < pattern.size(); ++i)
+            {
+                if((pattern[i] == ':' || pattern[i] == '*' || pattern[i] == '{') && i > 0 && pattern[i - 1] == '/')
+                {
+                    special = i;
+                    break;
+                }
+            }
+        }
+
+        if(special == std::string::npos)
+        {
+            node = insertStatic(node, std::string_view(pattern).substr(pos));
+            break;
+        }
+
+        if(special > pos)
+        {
+            node = insertStatic(node, std::string_view(pattern).substr(pos, special - pos));
+        }
+
+        size_t end = pattern.find('/', special);
+        if(end == std::string::npos)
+        {
+            end = pattern.size();
+        }
+        std::string name = pattern.substr(special + 1, end - special - 1);
+
+        if(pattern[special] == '{')
+        {
+            // {name} 或者 {name:类型}，必须占满整个路径段
+            if(name.empty() || name.back() != '}')
+            {
+                throw std::invalid_argument("unterminated '{' in route: " + pattern);
+            }
+            name.pop_back();
+            std::string spec;
+            size_t colon = name.find(':');
+            if(colon != std::string::npos)
+            {
+                spec = name.substr(colon + 1);
+                name.erase(colon);
+            }
+            node = insertParam(node, name, parseConstraint(spec, pattern), pattern);
+        }
+        else if(pattern[special] == ':')
+        {
+            node = insertParam(node, name, Constraint(), pattern);
+        }
+        else
+        {
+            if(end != pattern.size())
+            {
+                throw std::invalid_argument("wildcard must be the last segment in route: " + pattern);
+            }
+            if(name.empty())
+            {
+                name = "*";
+            }
+            if(!node->wildcardChild)
+            {
+                node->wildcardChild = std::make_unique<Node>();
+                node->wildcardChild->name = name;
+            }
+            else if(node->wildcardChild->name != name)
+            {
+                throw std::invalid_argument("wildcard *" + name + " conflicts with *"
+                                            + node->wildcardChild->name + " in route: " + pattern);
+            }
+            node = node->wildcardChild.get();
+        }
+        pos = end;
+    }
+
+    node->value = value;
+}
+
+RouteTree::Node* RouteTree::insertParam(Node* node, const std::string& name, Constraint constraint,
+                                        const std::string& pattern)
+{
+    if(name.empty())
+    {
+        throw std::invalid_argument("empty parameter name in route: " + pattern);
+    }
+
+    for(const auto& child : node->paramChildren)
+    {
+        if(child->constraint.spec == constraint.spec)
+        {
+            if(child->name != name)
+            {
+                throw std::invalid_argument("parameter " + name + " conflicts with "
+                                            + child->name + " in route: " + pattern);
+            }
+            return child.get();
+        }
+    }
+
+    auto child = std::make_unique<Node>();
+    child->name = name;
+    child->constraint = std::move(constraint);
+
+    // 不带类型的参数什么都能匹配，放在最后面
+    auto pos = node->paramChildren.end();
+    if(!child->constraint.spec.empty())
+    {
+        pos = node->paramChildren.begin();
+        while(pos != node->paramChildren.end() && !(*pos)->constraint.spec.empty())
+        {
+            ++pos;
+        }
+    }
+    return node->paramChildren.insert(pos, std::move(child))->get();
+}
+
+RouteTree::Constraint RouteTree::parseConstraint(const std::string& spec, const std::string& pattern)
+{
+    Constraint constraint;
+    constraint.spec = spec;
+    if(spec.empty())
+    {
+        return constraint;
+    }
+    if(spec == "int")
+    {
+        constraint.type = kInt;
+        return constraint;
+    }
+    if(spec == "uuid")
+    {
+        constraint.type = kUuid;
+        return constraint;
+    }
+
+    // [a-z0-9-]+ 这种字符集合，- 写在开头或者结尾的时候就是普通字符
+    if(spec.size() < 4 || spec.front() != '[' || spec.compare(spec.size() - 2, 2, "]+") != 0)
+    {
+        throw std::invalid_argument("unsupported parameter type {" + spec + "} in route: " + pattern);
+    }
+    constraint.charClass = true;
+    std::string_view body(spec.data() + 1, spec.size() - 3);
+    for(size_t i = 0; i < body.size(); ++i)
+    {
+        unsigned char lo = body[i];
+        unsigned char hi = lo;
+        if(i + 2 < body.size() && body[i + 1] == '-')
+        {
+            hi = body[i + 2];
+            i += 2;
+        }
+        if(lo > hi)
+        {
+            throw std::invalid_argument("bad range in parameter type {" + spec + "} in route: " + pattern);
+        }
+        for(unsigned c = lo; c <= hi; ++c)
+        {
+            constraint.chars.set(c);
+        }
+    }
+    return constraint;
+}
+
+namespace
+{
+
+int hexValue(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+// 检查路径段是否符合类型限制，同时把值解析到 param 里面
+bool RouteTree::scan(const Constraint& constraint, std::string_view segment, Param& param)
+{
+    param.type = constraint.type;
+
+    if(constraint.charClass)
+    {
+        for(char c : segment)
+        {
+            if(!constraint.chars.test(static_cast<unsigned char>(c)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if(constraint.type == kInt)
+    {
+        bool negative = segment[0] == '-';
+        size_t i = negative ? 1 : 0;
+        if(i == segment.size())
+        {
+            return false;
+        }
+        // 负数的绝对值可以比正数的最大值多 1
+        uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (negative ? 1 : 0);
+        uint64_t value = 0;
+        for(; i < segment.size(); ++i)
+        {
+            if(segment[i] < '0' || segment[i] > '9')
+            {
+                return false;
+            }
+            unsigned digit = segment[i] - '0';
+            if(value > (limit - digit) / 10)
+            {
+                return false;   // 溢出
+            }
+            value = value * 10 + digit;
+        }
+        param.intValue = negative ? static_cast<int64_t>(0 - value) : static_cast<int64_t>(value);
+        return true;
+    }
+
+    if(constraint.type == kUuid)
+    {
+        if(segment.size() != 36)
+        {
+            return false;
+        }
+        size_t byte = 0;
+        for(size_t i = 0; i < segment.size(); )
+        {
+            if(i == 8 || i == 13 || i == 18 || i == 23)
+            {
+                if(segment[i] != '-')
+                {
+                    return false;
+                }
+                ++i;
+                continue;
+            }
+            int high = hexValue(segment[i]);
+            int low = hexValue(segment[i + 1]);
+            if(high < 0 || low < 0)
+            {
+                return false;
+            }
+            param.uuid[byte++] = static_cast<uint8_t>(high << 4 | low);
+            i += 2;
+        }
+        return true;
+    }
+
+    return true;
+}
+
+// 插入一段静态文本，必要的时候把已有节点按公共前缀拆开
+RouteTree::Node* RouteTree::insertStatic(Node* node, std::string_view text)
+{
+    while(!text.empty())
+    {
+        size_t idx = node->indices.find(text[0]);
+        if(idx == std::string::npos)
+        {
+            auto child = std::make_unique<Node>();
+            child->prefix.assign(text.data(), text.size());
+            node->indices.push_back(text[0]);
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+
+        std::unique_ptr<Node>& slot = node->children[idx];
+        const std::string& prefix = slot->prefix;
+        size_t common = 0;
+        while(common < prefix.size() && common < text.size() && prefix[common] == text[common])
+        {
+            ++common;
+        }
+
+        if(common < prefix.size())
+        {
+            // 例如已有 /users，现在插入 /uploads，拆成 /u -> sers 和 /u -> ploads
+            auto mid = std::make_unique<Node>();
+            mid->prefix = prefix.substr(0, common);
+            slot->prefix.erase(0, common);
+            mid->indices.push_back(slot->prefix[0]);
+            mid->children.push_back(std::move(slot));
+            slot = std::move(mid);
+        }
+
+        node = slot.get();
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+int RouteTree::match(std::string_view path, Params& params) const
+{
+    params.clear();
+    return matchNode(root_.get(), path, params);
+}
+
+// node 自己的前缀已经匹配完了，path 是剩下还没匹配的部分
+int RouteTree::matchNode(const Node* node, std::string_view path, Params& params)
+{
+    if(path.empty())
+    {
+        if(node->value >= 0)
+        {
+            return node->value;
+        }
+        // /static/*filepath 也可以匹配 /static/
+        if(node->wildcardChild && node->wildcardChild->value >= 0)
+        {
+            params.push_back(Param{&node->wildcardChild->name, path, kString, 0, {}});
+            return node->wildcardChild->value;
+        }
+        return -1;
+    }
+
+    // 1. 静态子节点
+    size_t idx = node->indices.find(path[0]);
+    if(idx != std::string::npos)
+    {
+        const Node* child = node->children[idx].get();
+        if(path.substr(0, child->prefix.size()) == child->prefix)
+        {
+            int value = matchNode(child, path.substr(child->prefix.size()), params);
+            if(value >= 0)
+            {
+                return value;
+            }
+        }
+    }
+
+    // 2. 参数节点，匹配到下一个 / 为止，类型不符合的直接跳过
+    if(!node->paramChildren.empty())
+    {
+        std::string_view segment = path.substr(0, path.find('/'));
+        if(!segment.empty())
+        {
+            for(const auto& child : node->paramChildren)
+            {
+                Param param{&child->name, segment, kString, 0, {}};
+                if(!scan(child->constraint, segment, param))
+                {
+                    continue;
+                }
+                params.push_back(param);
+                int value = matchNode(child.get(), path.substr(segment.size()), params);
+                if(value >= 0)
+                {
+                    return value;
+                }
+                params.pop_back();
+            }
+        }
+    }
+
+    // 3. 通配符，匹配剩下的全部
+    if(node->wildcardChild && node->wildcardChild->value >= 0)
+    {
+        params.push_back(Param{&node->wildcardChild->name, path, kString, 0, {}});
+        return node->wildcardChild->value;
+    }
+
+    return -1;
+}
+
+}   // namespace router
+}   // namespace http
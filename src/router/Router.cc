@@ -1,79 +1,272 @@
 #include "../../include/router/Router.h"
+#include "../../include/trace/Tracer.h"
+
+#include <algorithm>
 
 namespace http
 {
 namespace router
 {
-    
+
+Router::Router()
+    : table_(new RouteTable())
+{}
+
+Router::~Router()
+{
+    delete table_.load(std::memory_order_acquire);
+}
+
 // 注册路由处理器
 void Router::registerHandler(HttpRequest::Method method, const std::string& path, HandlerPtr handler)
 {
-    RouteKey key{method, path};
-    handlers_[key] = std::move(handler);
+    addRoute(method, path, std::move(handler), nullptr, true);
 }
 
 // 注册回调函数形式的处理器
 void Router::registerCallback(HttpRequest::Method method, const std::string& path, const HandlerCallback callback)
 {
-    RouteKey key{method, path};
-    callbacks_[key] = callback;
+    addRoute(method, path, nullptr, callback, true);
+}
+
+void Router::addPatternHandler(HttpRequest::Method method, const std::string& path, HandlerPtr handler)
+{
+    addRoute(method, path, std::move(handler), nullptr, false);
+}
+
+void Router::addPatternCallback(HttpRequest::Method method, const std::string &path, const HandlerCallback& callback)
+{
+    addRoute(method, path, nullptr, callback, false);
 }
 
-bool Router::route(const HttpRequest &req, HttpResponse* resp)
+void Router::addRoute(HttpRequest::Method method, const std::string& path, HandlerPtr handler,
+                      HandlerCallback callback, bool literal)
 {
-    RouteKey key{req.method(), req.path()};
+    RouteSpec spec{method, path, literal,
+                   RouteEntry{std::move(handler), std::move(callback), registerMetrics(method, path), nullptr, path}};
 
-    // 查找处理器
-    auto handlerIt = handlers_.find(key);
-    if(handlerIt != handlers_.end())
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<RouteSpec> specs = specs_;
+    // 同一条路由重复注册的时候，用新的处理器替换掉旧的
+    auto it = std::find_if(specs.begin(), specs.end(), [&](const RouteSpec& s) {
+        return s.method == method && s.path == path;
+    });
+    if(it != specs.end())
     {
-        handlerIt->second->handle(req, resp);
-        return true;
+        *it = std::move(spec);
+    }
+    else
+    {
+        specs.push_back(std::move(spec));
+    }
+
+    // 路由写错了的时候 buildTable 抛出异常，当前的路由表和 specs_ 都不会改变
+    std::unique_ptr<RouteTable> table = buildTable(specs);
+    specs_ = std::move(specs);
+    publish(std::move(table));
+}
+
+bool Router::removeRoute(HttpRequest::Method method, const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(specs_.begin(), specs_.end(), [&](const RouteSpec& s) {
+        return s.method == method && s.path == path;
+    });
+    if(it == specs_.end())
+    {
+        return false;
+    }
+    specs_.erase(it);
+    publish(buildTable(specs_));
+    return true;
+}
+
+void Router::addMiddleware(const std::string& prefix, std::shared_ptr<middleware::Middleware> middleware)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    middlewares_.emplace_back(prefix, std::move(middleware));
+    publish(buildTable(specs_));
+}
+
+void Router::setReclaimer(Reclaimer reclaimer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    reclaimer_ = std::move(reclaimer);
+}
+
+std::unique_ptr<Router::RouteTable> Router::buildTable(const std::vector<RouteSpec>& specs) const
+{
+    auto table = std::make_unique<RouteTable>();
+
+    // 1. 每个前缀一条中间件链，同一个前缀的路由共用这一条
+    for(const auto& scoped : middlewares_)
+    {
+        const std::string& prefix = scoped.first;
+        bool seen = std::any_of(table->prefixChains_.begin(), table->prefixChains_.end(),
+                                [&](const auto& pc) { return pc.first == prefix; });
+        if(seen)
+        {
+            continue;
+        }
+        auto chain = std::make_shared<middleware::MiddlewareChain>();
+        for(const auto& candidate : middlewares_)
+        {
+            if(prefixMatches(candidate.first, prefix))
+            {
+                chain->addMiddleware(candidate.second);
+            }
+        }
+        table->prefixChains_.emplace_back(prefix, std::move(chain));
+    }
+    std::stable_sort(table->prefixChains_.begin(), table->prefixChains_.end(),
+                     [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+
+    // 2. 路由和它的中间件链
+    table->routes_.reserve(specs.size());
+    for(const RouteSpec& spec : specs)
+    {
+        int index = static_cast<int>(table->routes_.size());
+        table->routes_.push_back(spec.entry);
+        table->routes_.back().chain_ = findChain(*table, spec.path);
+        table->trees_[spec.method].insert(spec.path, index, spec.literal);
     }
 
-    // 查找回调函数
-    auto callbackIt = callbacks_.find(key);
-    if(callbackIt != callbacks_.end())
+    table->staticRoutes_ = staticRoutes_;
+    for(const std::string& path : staticRoutes_.paths)
+    {
+        table->staticRoutes_.chains.push_back(findChain(*table, path));
+    }
+    return table;
+}
+
+bool Router::prefixMatches(const std::string& prefix, const std::string& path)
+{
+    if(prefix.empty() || prefix == "/")
     {
-        callbackIt->second(req, resp);
         return true;
     }
+    if(path.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    // 按路径段匹配，/api 不匹配 /apix
+    return path.size() == prefix.size() || path[prefix.size()] == '/' || prefix.back() == '/';
+}
+
+Router::ChainPtr Router::findChain(const RouteTable& table, const std::string& path)
+{
+    for(const auto& prefixChain : table.prefixChains_)
+    {
+        if(prefixMatches(prefixChain.first, path))
+        {
+            return prefixChain.second;
+        }
+    }
+    return nullptr;
+}
 
-    // 查找动态路由处理器
-    for(const auto &[method, pathRegex, handler] : regexHandlers_)
+const middleware::MiddlewareChain* Router::chainFor(const std::string& path) const
+{
+    const RouteTable* table = table_.load(std::memory_order_acquire);
+    for(const auto& prefixChain : table->prefixChains_)
     {
-        std::smatch match;
-        std::string pathStr(req.path());
-        // 如果方法匹配并且动态路由也匹配，则执行处理器
-        if( method == req.method() && std::regex_match(pathStr, match, pathRegex))
+        if(prefixMatches(prefixChain.first, path))
         {
-            // Extract path parameters and add them to the request
-            HttpRequest newReq(req);
-            extractPathParameters(match, newReq);
-            
-            handler->handle(newReq, resp);
-            return true;
+            return prefixChain.second.get();
         }
     }
+    return nullptr;
+}
 
-    // 查找动态路由回调函数
-    for(const auto& [method, pathRegex, callback] : regexCallbacks_)
+void Router::publish(std::unique_ptr<RouteTable> table)
+{
+    const RouteTable* old = table_.exchange(table.release(), std::memory_order_acq_rel);
+    if(!old)
     {
-        std::smatch match;
-        std::string pathStr(req.path());
+        return;
+    }
+
+    if(reclaimer_)
+    {
+        reclaimer_([old] { delete old; });
+    }
+    else
+    {
+        // 还没有 IO 线程在读
+        delete old;
+    }
+}
+
+bool Router::route(HttpRequest &req, HttpResponse* resp)
+{
+    int method = req.method();
+    if(method < 0 || method >= kMethodCount)
+    {
+        return false;
+    }
 
-        if(method == req.method() && std::regex_match(pathStr, match, pathRegex))
+    // 不加锁，旧表在当前 IO loop 处理完这次事件之前不会被释放
+    const RouteTable* table = table_.load(std::memory_order_acquire);
+    trace::RequestTrace* trace = req.trace();
+    trace::ScopedPhase match(trace, "route.match");
+
+    // 先查编译期路由表，只有字面路径，不需要设置参数
+    const StaticRoutes& staticRoutes = table->staticRoutes_;
+    if(staticRoutes.dispatch && staticRoutes.dispatch(staticRoutes, req, resp, match))
+    {
+        return true;
+    }
+
+    RouteTree::Params params;
+    int index = table->trees_[method].match(req.path(), params);
+    match.finish();
+    if(index < 0)
+    {
+        return false;
+    }
+
+    // 路径参数直接设置到原请求上，不用为了加参数把整个请求(包括 body)拷贝一份
+    // 带类型的参数同时设置解析好的值，原始字符串也保留一份
+    for(const auto& param : params)
+    {
+        req.setPathParameters(*param.name, std::string(param.text));
+        if(param.type == RouteTree::kInt)
+        {
+            req.setPathParameters(*param.name, param.intValue);
+        }
+        else if(param.type == RouteTree::kUuid)
         {
-            HttpRequest newReq(req);
-            extractPathParameters(match, newReq);
-            
-            callback(newReq, resp);
-            return true;
+            req.setPathParameters(*param.name, param.uuid);
         }
     }
 
-    return false;
+    // 只执行这条路由自己的中间件链，没有中间件的路由直接调用处理器
+    // 中间件直接给出响应的时候(返回 kRespond)不再调用处理器
+    const RouteEntry& entry = table->routes_[index];
+    if(trace)
+    {
+        trace->route = entry.pattern_;
+    }
+    size_t entered = 0;
+    if(!entry.chain_ || entry.chain_->processBefore(req, *resp, entered))
+    {
+        metrics::ScopedRouteTimer timer(entry.routeId_);
+        trace::ScopedPhase phase(trace, "handler");
+        if(entry.handler_)
+        {
+            entry.handler_->handle(req, resp);
+        }
+        else
+        {
+            entry.callback_(req, resp);
+        }
+    }
+    if(entry.chain_)
+    {
+        entry.chain_->processAfter(req, *resp, entered);
+    }
+    return true;
 }
 
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,256 @@
+#include "../../include/session/CookieSessionCodec.h"
+#include "../../include/utils/Base64Url.h"
+#include "../../include/utils/JsonUtil.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <muduo/base/Logging.h>
+
+namespace http
+{
+namespace session
+{
+
+namespace
+{
+
+const char kSignedPrefix[] = "s1.";
+const char kSealedPrefix[] = "e1.";
+const size_t kPrefixLength = 3;
+
+const size_t kIvLength = 12;
+const size_t kTagLength = 16;
+
+// 加密的时候把版本号作为附加数据，版本号被改了解密会失败
+const unsigned char kSealedAad[] = {'e', '1'};
+
+int64_t toMillis(Session::Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+CookieSessionCodec::CookieSessionCodec(const CookieSessionConfig& config)
+    : config_(config)
+    , cipher_(EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr))
+{
+    if(config_.secrets.empty())
+    {
+        EVP_CIPHER_free(cipher_);
+        throw std::invalid_argument("CookieSessionCodec: at least one secret is required");
+    }
+    if(!cipher_)
+    {
+        throw std::runtime_error("CookieSessionCodec: AES-256-GCM is not available");
+    }
+
+    // 签名和加密用不同的子密钥，同一个密钥不用在两种算法上
+    for(const auto& secret : config_.secrets)
+    {
+        const char macLabel[] = "cookie-session mac";
+        const char encLabel[] = "cookie-session enc";
+        keys_.push_back(Key{hmacSha256(secret, macLabel, sizeof(macLabel) - 1),
+                            hmacSha256(secret, encLabel, sizeof(encLabel) - 1)});
+    }
+}
+
+CookieSessionCodec::~CookieSessionCodec()
+{
+    EVP_CIPHER_free(cipher_);
+}
+
+std::string CookieSessionCodec::encode(const Session& session) const
+{
+    json payload;
+    payload["i"] = session.getId();
+    payload["e"] = toMillis(session.expiryTime());
+    payload["d"] = session.snapshot();
+    std::string text = payload.dump(-1, ' ', false, json::error_handler_t::replace);
+
+    std::string value = config_.encrypt ? seal(text) : sign(text);
+    if(value.size() + config_.cookieName.size() + 1 > config_.maxCookieSize)
+    {
+        LOG_ERROR << "CookieSessionCodec: session " << session.getId() << " is too large for a cookie ("
+                  << value.size() << " bytes), keep the data small or use a server side storage";
+        return std::string();
+    }
+    return value;
+}
+
+std::shared_ptr<Session> CookieSessionCodec::decode(const std::string& value, bool& rotated) const
+{
+    rotated = false;
+    std::string payload;
+    bool ok = false;
+    if(value.compare(0, kPrefixLength, kSignedPrefix) == 0)
+    {
+        ok = verify(value, payload, rotated);
+    }
+    else if(value.compare(0, kPrefixLength, kSealedPrefix) == 0)
+    {
+        ok = open(value, payload, rotated);
+    }
+
+    // 切换了是否加密之后，另一种格式的旧 cookie 也接受，下次写回的时候换成现在的格式
+    if(ok && (value[0] == 'e') != config_.encrypt)
+    {
+        rotated = true;
+    }
+    return ok ? parse(payload) : nullptr;
+}
+
+std::string CookieSessionCodec::sign(const std::string& payload) const
+{
+    std::string value = kSignedPrefix;
+    value += Base64Url::encode(payload);
+    std::string mac = hmacSha256(keys_.front().macKey, value.data(), value.size());
+    value += '.';
+    value += Base64Url::encode(mac);
+    return value;
+}
+
+std::string CookieSessionCodec::seal(const std::string& payload) const
+{
+    std::string sealed(kIvLength + payload.size() + kTagLength, '\0');
+    unsigned char* iv = reinterpret_cast<unsigned char*>(&sealed[0]);
+    unsigned char* out = iv + kIvLength;
+    if(RAND_bytes(iv, static_cast<int>(kIvLength)) != 1)
+    {
+        LOG_ERROR << "CookieSessionCodec: RAND_bytes failed";
+        return std::string();
+    }
+
+    const Key& key = keys_.front();
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    bool ok = ctx
+        && EVP_EncryptInit_ex2(ctx, cipher_, reinterpret_cast<const unsigned char*>(key.encKey.data()), iv, nullptr) == 1
+        && EVP_EncryptUpdate(ctx, nullptr, &len, kSealedAad, sizeof(kSealedAad)) == 1
+        && EVP_EncryptUpdate(ctx, out, &len, reinterpret_cast<const unsigned char*>(payload.data()),
+                             static_cast<int>(payload.size())) == 1
+        && EVP_EncryptFinal_ex(ctx, out + len, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(kTagLength), out + payload.size()) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+    if(!ok)
+    {
+        LOG_ERROR << "CookieSessionCodec: encryption failed";
+        return std::string();
+    }
+    return kSealedPrefix + Base64Url::encode(sealed);
+}
+
+bool CookieSessionCodec::verify(const std::string& value, std::string& payload, bool& rotated) const
+{
+    size_t dot = value.rfind('.');
+    if(dot == std::string::npos || dot < kPrefixLength)
+    {
+        return false;
+    }
+    std::string signature;
+    if(!Base64Url::decode(value.data() + dot + 1, value.size() - dot - 1, signature))
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < keys_.size(); ++i)
+    {
+        std::string mac = hmacSha256(keys_[i].macKey, value.data(), dot);
+        // 常数时间比较，不能让比较的耗时泄露签名的前缀
+        if(signature.size() == mac.size() && CRYPTO_memcmp(signature.data(), mac.data(), mac.size()) == 0)
+        {
+            rotated = i > 0;
+            return Base64Url::decode(value.data() + kPrefixLength, dot - kPrefixLength, payload);
+        }
+    }
+    return false;
+}
+
+bool CookieSessionCodec::open(const std::string& value, std::string& payload, bool& rotated) const
+{
+    std::string sealed;
+    if(!Base64Url::decode(value.data() + kPrefixLength, value.size() - kPrefixLength, sealed)
+       || sealed.size() < kIvLength + kTagLength)
+    {
+        return false;
+    }
+
+    const unsigned char* iv = reinterpret_cast<const unsigned char*>(sealed.data());
+    const unsigned char* in = iv + kIvLength;
+    size_t inLength = sealed.size() - kIvLength - kTagLength;
+    unsigned char* tag = reinterpret_cast<unsigned char*>(&sealed[0]) + kIvLength + inLength;
+
+    payload.resize(inLength);
+    unsigned char* out = reinterpret_cast<unsigned char*>(&payload[0]);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    bool ok = false;
+    for(size_t i = 0; ctx && i < keys_.size() && !ok; ++i)
+    {
+        int len = 0;
+        ok = EVP_DecryptInit_ex2(ctx, cipher_, reinterpret_cast<const unsigned char*>(keys_[i].encKey.data()), iv, nullptr) == 1
+            && EVP_DecryptUpdate(ctx, nullptr, &len, kSealedAad, sizeof(kSealedAad)) == 1
+            && EVP_DecryptUpdate(ctx, out, &len, in, static_cast<int>(inLength)) == 1
+            && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(kTagLength), tag) == 1
+            && EVP_DecryptFinal_ex(ctx, out + len, &len) == 1;
+        rotated = i > 0;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+std::shared_ptr<Session> CookieSessionCodec::parse(const std::string& payload) const
+{
+    json root = json::parse(payload, nullptr, false);
+    if(!root.is_object())
+    {
+        return nullptr;
+    }
+    auto id = root.find("i");
+    auto expires = root.find("e");
+    auto data = root.find("d");
+    if(id == root.end() || !id->is_string()
+       || expires == root.end() || !expires->is_number_integer()
+       || data == root.end() || !data->is_object())
+    {
+        return nullptr;
+    }
+
+    Session::Clock::time_point expiry(std::chrono::duration_cast<Session::Clock::duration>(
+        std::chrono::milliseconds(expires->get<int64_t>())));
+    if(expiry <= Session::Clock::now())
+    {
+        return nullptr;
+    }
+
+    std::unordered_map<std::string, std::string> values;
+    for(auto it = data->begin(); it != data->end(); ++it)
+    {
+        if(it.value().is_string())
+        {
+            values.emplace(it.key(), it.value().get<std::string>());
+        }
+    }
+    auto session = std::make_shared<Session>(id->get<std::string>(), nullptr, config_.maxAge);
+    session->restore(std::move(values), expiry);
+    return session;
+}
+
+std::string CookieSessionCodec::hmacSha256(const std::string& key, const char* data, size_t len)
+{
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int macLen = 0;
+    if(!HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()),
+             reinterpret_cast<const unsigned char*>(data), len, mac, &macLen))
+    {
+        return std::string();
+    }
+    return std::string(reinterpret_cast<const char*>(mac), macLen);
+}
+
+} // namespace session
+} // namespace http
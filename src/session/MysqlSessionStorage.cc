@@ -0,0 +1,449 @@
+#include "../../include/session/MysqlSessionStorage.h"
+#include "../../include/utils/JsonUtil.h"
+#include "../../include/utils/db/DbConnectionPool.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+#include <muduo/base/Logging.h>
+
+namespace http
+{
+namespace session
+{
+
+MysqlSessionStorage::MysqlSessionStorage(const MysqlSessionConfig& config)
+    : config_(config)
+    , upsertPrefix_("INSERT INTO " + config.table + " (id, data, expires_at) VALUES ")
+    , upsertSuffix_(" ON DUPLICATE KEY UPDATE data = VALUES(data), expires_at = VALUES(expires_at)")
+    , selectSql_("SELECT data, expires_at FROM " + config.table + " WHERE id = ? AND expires_at > ?")
+    , running_(true)
+{
+    config_.batchSize = std::max<size_t>(config_.batchSize, 1);
+    thread_ = std::thread(&MysqlSessionStorage::writeLoop, this);
+}
+
+MysqlSessionStorage::~MysqlSessionStorage()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void MysqlSessionStorage::save(std::shared_ptr<Session> session)
+{
+    cachePut(session);
+    const std::string& sessionId = session->getId();
+    enqueue(sessionId, std::move(session));
+}
+
+std::shared_ptr<Session> MysqlSessionStorage::load(const std::string& sessionId)
+{
+    CacheShard& shard = shardFor(sessionId);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(sessionId);
+        if(it != shard.entries.end())
+        {
+            CacheEntry& entry = it->second;
+            bool fresh = config_.cacheTtlMs <= 0
+                || Clock::now() - entry.loadedAt < std::chrono::milliseconds(config_.cacheTtlMs);
+            if(fresh && !entry.session->isExpired())
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruIt);
+                return entry.session;
+            }
+            shard.lru.erase(entry.lruIt);
+            shard.entries.erase(it);
+        }
+    }
+
+    // 还没有写进数据库的改动比数据库里面的新
+    std::shared_ptr<Session> session;
+    if(findQueued(sessionId, session))
+    {
+        if(!session || session->isExpired())
+        {
+            return nullptr;
+        }
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.misses.find(sessionId);
+            if(it != shard.misses.end())
+            {
+                if(Clock::now() < it->second)
+                {
+                    return nullptr;
+                }
+                shard.misses.erase(it);
+            }
+        }
+
+        session = loadFromDb(sessionId);
+        if(!session)
+        {
+            cacheMiss(sessionId);
+            return nullptr;
+        }
+    }
+    cachePut(session);
+    return session;
+}
+
+void MysqlSessionStorage::remove(const std::string& sessionId)
+{
+    cacheErase(sessionId);
+    enqueue(sessionId, nullptr);
+}
+
+void MysqlSessionStorage::flush(std::shared_ptr<Session> session, const SessionChanges& changes)
+{
+    // 只刷新了过期时间也要写，数据库里面的 expires_at 决定会话什么时候被删除
+    if(changes.empty())
+    {
+        return;
+    }
+    save(std::move(session));
+}
+
+void MysqlSessionStorage::cleanExpired()
+{
+    for(auto& shard : cache_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for(auto it = shard.entries.begin(); it != shard.entries.end(); )
+        {
+            if(it->second.session->isExpired())
+            {
+                shard.lru.erase(it->second.lruIt);
+                it = shard.entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        for(auto it = shard.misses.begin(); it != shard.misses.end(); )
+        {
+            it = it->second <= now ? shard.misses.erase(it) : std::next(it);
+        }
+    }
+}
+
+MysqlSessionStorage::CacheShard& MysqlSessionStorage::shardFor(const std::string& sessionId)
+{
+    return cache_[std::hash<std::string>()(sessionId) % kShardCount];
+}
+
+void MysqlSessionStorage::cachePut(const std::shared_ptr<Session>& session)
+{
+    CacheShard& shard = shardFor(session->getId());
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.misses.erase(session->getId());
+    if(config_.cacheEntries == 0)
+    {
+        return;
+    }
+
+    auto it = shard.entries.find(session->getId());
+    if(it == shard.entries.end())
+    {
+        shard.lru.push_front(session->getId());
+        it = shard.entries.emplace(session->getId(), CacheEntry{session, Clock::now(), shard.lru.begin()}).first;
+    }
+    else
+    {
+        // 本进程写的，比数据库里面的新，重新开始计算缓存时间
+        it->second.session = session;
+        it->second.loadedAt = Clock::now();
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruIt);
+    }
+
+    size_t limit = config_.cacheEntries / kShardCount + 1;
+    while(shard.entries.size() > limit)
+    {
+        shard.entries.erase(shard.lru.back());
+        shard.lru.pop_back();
+    }
+}
+
+void MysqlSessionStorage::cacheErase(const std::string& sessionId)
+{
+    CacheShard& shard = shardFor(sessionId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(sessionId);
+    if(it != shard.entries.end())
+    {
+        shard.lru.erase(it->second.lruIt);
+        shard.entries.erase(it);
+    }
+}
+
+void MysqlSessionStorage::cacheMiss(const std::string& sessionId)
+{
+    if(config_.missCacheMs <= 0)
+    {
+        return;
+    }
+
+    CacheShard& shard = shardFor(sessionId);
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // 随机的 id 查不到的最多，满了先去掉过期的，还是满的就不记了，不挤占缓存的会话
+    size_t limit = config_.cacheEntries / kShardCount + 1;
+    if(shard.misses.size() >= limit)
+    {
+        for(auto it = shard.misses.begin(); it != shard.misses.end(); )
+        {
+            it = it->second <= now ? shard.misses.erase(it) : std::next(it);
+        }
+        if(shard.misses.size() >= limit)
+        {
+            return;
+        }
+    }
+    shard.misses[sessionId] = now + std::chrono::milliseconds(config_.missCacheMs);
+}
+
+void MysqlSessionStorage::enqueue(const std::string& sessionId, std::shared_ptr<Session> session)
+{
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_[sessionId] = std::move(session);
+        notify = queued_.size() >= config_.batchSize;
+    }
+    if(notify)
+    {
+        cond_.notify_one();
+    }
+}
+
+bool MysqlSessionStorage::findQueued(const std::string& sessionId, std::shared_ptr<Session>& session)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queued_.find(sessionId);
+    if(it == queued_.end())
+    {
+        it = writing_.find(sessionId);
+        if(it == writing_.end())
+        {
+            return false;
+        }
+    }
+    session = it->second;
+    return true;
+}
+
+std::shared_ptr<Session> MysqlSessionStorage::loadFromDb(const std::string& sessionId)
+{
+    try
+    {
+        const std::string now = std::to_string(nowMillis());
+        auto conn = db::DbConnectionPool::getInstance().getConnection();
+        std::unique_ptr<sql::ResultSet> result(conn->executeQuery(selectSql_, sessionId, now));
+        if(!result || !result->next())
+        {
+            return nullptr;
+        }
+
+        json data = json::parse(result->getString("data"), nullptr, false);
+        if(!data.is_object())
+        {
+            LOG_WARN << "MysqlSessionStorage: invalid session data, id=" << sessionId;
+            return nullptr;
+        }
+        std::unordered_map<std::string, std::string> values;
+        for(auto it = data.begin(); it != data.end(); ++it)
+        {
+            if(it.value().is_string())
+            {
+                values.emplace(it.key(), it.value().get<std::string>());
+            }
+        }
+
+        int64_t expiresMs = result->getInt64("expires_at");
+        Session::Clock::time_point expiry(std::chrono::duration_cast<Session::Clock::duration>(std::chrono::milliseconds(expiresMs)));
+        auto session = std::make_shared<Session>(sessionId, nullptr);
+        session->restore(std::move(values), expiry);
+        return session;
+    }
+    catch(const std::exception& e)
+    {
+        // 数据库不可用的时候当作会话不存在，请求会拿到一个新的会话
+        LOG_ERROR << "MysqlSessionStorage: load failed, id=" << sessionId << ", error: " << e.what();
+        return nullptr;
+    }
+}
+
+void MysqlSessionStorage::writeLoop()
+{
+    int64_t nextPurge = nowMillis() + config_.purgeIntervalMs;
+    bool running = true;
+    while(running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(config_.flushIntervalMs), [this] {
+                return !running_ || queued_.size() >= config_.batchSize;
+            });
+            writing_.swap(queued_);
+            running = running_;
+        }
+
+        // writing_ 只在锁里面修改，这里在锁外面只读，load 可以同时在锁里面查它
+        WriteMap failed;
+        if(!writing_.empty())
+        {
+            failed = writeBatch(writing_);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(auto& item : failed)
+            {
+                // 写失败的期间又有新的写操作的，以新的为准
+                queued_.emplace(item.first, std::move(item.second));
+            }
+            writing_.clear();
+        }
+
+        if(config_.purgeIntervalMs > 0 && nowMillis() >= nextPurge)
+        {
+            purgeExpired();
+            nextPurge = nowMillis() + config_.purgeIntervalMs;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!queued_.empty())
+    {
+        LOG_ERROR << "MysqlSessionStorage: " << queued_.size() << " session writes lost on shutdown";
+    }
+}
+
+MysqlSessionStorage::WriteMap MysqlSessionStorage::writeBatch(const WriteMap& batch)
+{
+    std::vector<std::shared_ptr<Session>> upserts;
+    std::vector<std::string> erases;
+    for(const auto& item : batch)
+    {
+        if(item.second)
+        {
+            upserts.push_back(item.second);
+        }
+        else
+        {
+            erases.push_back(item.first);
+        }
+    }
+
+    WriteMap failed;
+    for(size_t begin = 0; begin < upserts.size(); begin += config_.batchSize)
+    {
+        std::vector<std::shared_ptr<Session>> chunk(upserts.begin() + begin,
+                                                    upserts.begin() + std::min(begin + config_.batchSize, upserts.size()));
+        try
+        {
+            upsert(chunk);
+        }
+        catch(const std::exception& e)
+        {
+            LOG_ERROR << "MysqlSessionStorage: upsert of " << chunk.size() << " sessions failed: " << e.what();
+            for(auto& session : chunk)
+            {
+                failed.emplace(session->getId(), std::move(session));
+            }
+        }
+    }
+
+    for(size_t begin = 0; begin < erases.size(); begin += config_.batchSize)
+    {
+        std::vector<std::string> chunk(erases.begin() + begin,
+                                       erases.begin() + std::min(begin + config_.batchSize, erases.size()));
+        try
+        {
+            erase(chunk);
+        }
+        catch(const std::exception& e)
+        {
+            LOG_ERROR << "MysqlSessionStorage: delete of " << chunk.size() << " sessions failed: " << e.what();
+            for(auto& sessionId : chunk)
+            {
+                failed.emplace(std::move(sessionId), nullptr);
+            }
+        }
+    }
+    return failed;
+}
+
+void MysqlSessionStorage::upsert(const std::vector<std::shared_ptr<Session>>& sessions)
+{
+    std::string sql = upsertPrefix_;
+    std::vector<std::string> params;
+    params.reserve(sessions.size() * 3);
+    for(size_t i = 0; i < sessions.size(); ++i)
+    {
+        sql += i == 0 ? "(?, ?, ?)" : ", (?, ?, ?)";
+
+        // 写的时候才取数据，同一批里面的会话都是最新的
+        const Session& session = *sessions[i];
+        json data(session.snapshot());
+        params.push_back(session.getId());
+        params.push_back(data.dump(-1, ' ', false, json::error_handler_t::replace));
+        params.push_back(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+            session.expiryTime().time_since_epoch()).count()));
+    }
+    sql += upsertSuffix_;
+
+    auto conn = db::DbConnectionPool::getInstance().getConnection();
+    conn->executeBatchUpdate(sql, params);
+}
+
+void MysqlSessionStorage::erase(const std::vector<std::string>& sessionIds)
+{
+    std::string sql = "DELETE FROM " + config_.table + " WHERE id IN (";
+    for(size_t i = 0; i < sessionIds.size(); ++i)
+    {
+        sql += i == 0 ? "?" : ", ?";
+    }
+    sql += ")";
+
+    auto conn = db::DbConnectionPool::getInstance().getConnection();
+    conn->executeBatchUpdate(sql, sessionIds);
+}
+
+void MysqlSessionStorage::purgeExpired()
+{
+    try
+    {
+        std::string sql = "DELETE FROM " + config_.table + " WHERE expires_at <= ? LIMIT " + std::to_string(config_.purgeBatch);
+        auto conn = db::DbConnectionPool::getInstance().getConnection();
+        int deleted = conn->executeBatchUpdate(sql, {std::to_string(nowMillis())});
+        if(deleted > 0)
+        {
+            LOG_DEBUG << "MysqlSessionStorage: purged " << deleted << " expired sessions";
+        }
+    }
+    catch(const std::exception& e)
+    {
+        LOG_ERROR << "MysqlSessionStorage: purge failed: " << e.what();
+    }
+}
+
+int64_t MysqlSessionStorage::nowMillis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Session::Clock::now().time_since_epoch()).count();
+}
+
+} // namespace session
+} // namespace http
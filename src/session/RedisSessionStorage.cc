@@ -0,0 +1,774 @@
+#include "../../include/session/RedisSessionStorage.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <muduo/base/Logging.h>
+
+namespace http
+{
+namespace session
+{
+
+namespace
+{
+
+// 过期时间(毫秒)存在 hash 的这个字段里面，用户数据不要用这个 key
+const char kExpiresField[] = "__expires";
+
+std::atomic<uint64_t> nextStorageId{1};
+
+int64_t parseInteger(const char* begin, const char* end, bool& ok)
+{
+    int64_t value = 0;
+    bool negative = begin < end && *begin == '-';
+    const char* p = negative ? begin + 1 : begin;
+    ok = p < end;
+    for(; p < end && ok; ++p)
+    {
+        ok = *p >= '0' && *p <= '9';
+        value = value * 10 + (*p - '0');
+    }
+    return negative ? -value : value;
+}
+
+} // namespace
+
+RedisSessionStorage::RedisSessionStorage(const RedisSessionConfig& config)
+    : config_(config)
+    , id_(nextStorageId++)
+{
+    // 只在这里解析一次，连接和重连都在 IO 线程上，不能做阻塞的 DNS 查询
+    struct addrinfo hints;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    std::string port = std::to_string(config_.port);
+    if(::getaddrinfo(config_.host.c_str(), port.c_str(), &hints, &result) != 0 || !result)
+    {
+        LOG_ERROR << "RedisSessionStorage: cannot resolve " << config_.host << ", sessions will not be stored";
+        return;
+    }
+    ::memcpy(&endpoint_.address, result->ai_addr, result->ai_addrlen);
+    endpoint_.length = result->ai_addrlen;
+    ::freeaddrinfo(result);
+}
+
+RedisSessionStorage::~RedisSessionStorage()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_.clear();
+}
+
+void RedisSessionStorage::save(std::shared_ptr<Session> session)
+{
+    writeAll(session);
+}
+
+std::shared_ptr<Session> RedisSessionStorage::load(const std::string& sessionId)
+{
+    Reply reply;
+    if(!localConnection().call({"HGETALL", keyFor(sessionId)}, reply) || reply.type != Reply::kArray)
+    {
+        return nullptr;
+    }
+
+    // 字段和值交替出现，没有这个 key 的时候是空数组
+    std::unordered_map<std::string, std::string> data;
+    int64_t expiresMs = -1;
+    for(size_t i = 0; i + 1 < reply.elements.size(); i += 2)
+    {
+        const std::string& field = reply.elements[i].str;
+        if(field == kExpiresField)
+        {
+            bool ok = false;
+            expiresMs = parseInteger(reply.elements[i + 1].str.data(),
+                                     reply.elements[i + 1].str.data() + reply.elements[i + 1].str.size(), ok);
+            expiresMs = ok ? expiresMs : -1;
+        }
+        else
+        {
+            data.emplace(field, std::move(reply.elements[i + 1].str));
+        }
+    }
+    if(expiresMs < 0)
+    {
+        return nullptr;
+    }
+
+    Session::Clock::time_point expiry(std::chrono::duration_cast<Session::Clock::duration>(std::chrono::milliseconds(expiresMs)));
+    if(expiry <= Session::Clock::now())
+    {
+        return nullptr;
+    }
+
+    auto session = std::make_shared<Session>(sessionId, nullptr);
+    session->restore(std::move(data), expiry);
+    return session;
+}
+
+void RedisSessionStorage::remove(const std::string& sessionId)
+{
+    localConnection().send({"DEL", keyFor(sessionId)});
+}
+
+void RedisSessionStorage::flush(std::shared_ptr<Session> session, const SessionChanges& changes)
+{
+    if(changes.created)
+    {
+        writeAll(session);
+        return;
+    }
+
+    // 只写改过的字段，过期时间每次都带上
+    Connection& conn = localConnection();
+    std::string key = keyFor(session->getId());
+    std::string expires = millisString(session->expiryTime());
+
+    std::vector<std::string> hset{"HSET", key, kExpiresField, expires};
+    for(const auto& item : changes.updated)
+    {
+        hset.push_back(item.first);
+        hset.push_back(item.second);
+    }
+
+    bool dataChanged = changes.dataChanged();
+    if(dataChanged)
+    {
+        conn.send({"MULTI"});
+    }
+    conn.send(hset);
+    if(!changes.removed.empty())
+    {
+        std::vector<std::string> hdel{"HDEL", key};
+        hdel.insert(hdel.end(), changes.removed.begin(), changes.removed.end());
+        conn.send(hdel);
+    }
+    conn.send({"PEXPIREAT", key, expires});
+    if(dataChanged)
+    {
+        conn.send({"EXEC"});
+    }
+}
+
+void RedisSessionStorage::writeAll(const std::shared_ptr<Session>& session)
+{
+    Connection& conn = localConnection();
+    std::string key = keyFor(session->getId());
+    std::string expires = millisString(session->expiryTime());
+
+    std::vector<std::string> hset{"HSET", key, kExpiresField, expires};
+    for(auto& item : session->snapshot())
+    {
+        hset.push_back(item.first);
+        hset.push_back(std::move(item.second));
+    }
+
+    // 放在一个事务里面，别的进程不会读到删了一半的会话
+    conn.send({"MULTI"});
+    conn.send({"DEL", key});
+    conn.send(hset);
+    conn.send({"PEXPIREAT", key, expires});
+    conn.send({"EXEC"});
+}
+
+RedisSessionStorage::Connection& RedisSessionStorage::localConnection()
+{
+    // 先查线程局部的缓存，只有每个线程第一次用的时候才需要加锁
+    thread_local std::unordered_map<uint64_t, Connection*> cache;
+    auto it = cache.find(id_);
+    if(it != cache.end())
+    {
+        return *it->second;
+    }
+
+    auto conn = std::make_shared<Connection>(config_, endpoint_, muduo::net::EventLoop::getEventLoopOfCurrentThread());
+    conn->connect();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_[std::this_thread::get_id()] = conn;
+    }
+    cache[id_] = conn.get();
+    return *conn;
+}
+
+std::string RedisSessionStorage::keyFor(const std::string& sessionId) const
+{
+    return config_.keyPrefix + sessionId;
+}
+
+std::string RedisSessionStorage::millisString(Session::Clock::time_point time)
+{
+    return std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count());
+}
+
+RedisSessionStorage::Connection::Connection(const RedisSessionConfig& config, const Endpoint& endpoint,
+                                            muduo::net::EventLoop* loop)
+    : config_(config)
+    , endpoint_(endpoint)
+    , loop_(loop)
+    , owner_(std::this_thread::get_id())
+    , state_(kDisconnected)
+    , fd_(-1)
+    , backoffMs_(std::max(config.reconnectMinMs, 1))
+    , handshake_(0)
+    , dropped_(0)
+    , inputPos_(0)
+    , pending_(0)
+{}
+
+RedisSessionStorage::Connection::~Connection()
+{
+    if(channel_ && std::this_thread::get_id() != owner_)
+    {
+        // 存储在别的线程上析构(一般是进程退出的时候)，Channel 只能在所属的 loop 线程上摘掉，
+        // 这时候 loop 可能已经不在了，这里不去动它，关掉 fd 之后 epoll 不会再报告这个 fd 的事件
+        channel_.release();
+    }
+    close();
+}
+
+void RedisSessionStorage::Connection::connect()
+{
+    if(state_ != kDisconnected || endpoint_.length == 0)
+    {
+        return;
+    }
+
+    fd_ = ::socket(endpoint_.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd_ < 0)
+    {
+        fail("socket failed", errno);
+        return;
+    }
+    state_ = kConnecting;
+    int rc = ::connect(fd_, reinterpret_cast<const struct sockaddr*>(&endpoint_.address), endpoint_.length);
+    if(rc < 0 && errno != EINPROGRESS)
+    {
+        fail("connect failed", errno);
+        return;
+    }
+
+    if(loop_)
+    {
+        // 连接、回复、发送缓冲区满之后的继续发送都交给 loop
+        channel_.reset(new muduo::net::Channel(loop_, fd_));
+        std::weak_ptr<Connection> weak = shared_from_this();
+        channel_->setReadCallback([weak](muduo::Timestamp) {
+            if(auto conn = weak.lock()) conn->handleRead();
+        });
+        channel_->setWriteCallback([weak] {
+            if(auto conn = weak.lock()) conn->handleWrite();
+        });
+        channel_->setErrorCallback([weak] {
+            if(auto conn = weak.lock()) conn->handleError();
+        });
+        channel_->setCloseCallback([weak] {
+            if(auto conn = weak.lock()) conn->handleError();
+        });
+    }
+
+    if(rc == 0)
+    {
+        onConnected();
+    }
+    else if(loop_)
+    {
+        channel_->enableWriting();
+        // 服务器不回应的时候 connect 要等内核超时(几分钟)，这里按 timeoutMs 放弃这次连接
+        int fd = fd_;
+        std::weak_ptr<Connection> weak = shared_from_this();
+        loop_->runAfter(config_.timeoutMs / 1000.0, [weak, fd] {
+            auto conn = weak.lock();
+            if(conn && conn->state_ == kConnecting && conn->fd_ == fd)
+            {
+                conn->fail("connect timeout");
+            }
+        });
+    }
+}
+
+void RedisSessionStorage::Connection::send(const std::vector<std::string>& args)
+{
+    if(!ready())
+    {
+        // 断开期间每条命令都打日志会刷屏，连上之后一次性报告丢了多少
+        ++dropped_;
+        return;
+    }
+    appendCommand(args);
+    if(!writeSome())
+    {
+        fail("write failed", errno);
+    }
+}
+
+bool RedisSessionStorage::Connection::call(const std::vector<std::string>& args, Reply& reply)
+{
+    if(!ready())
+    {
+        return false;
+    }
+
+    // 在这条命令前面发出去的命令(包括 AUTH / SELECT)的回复会先到，按顺序跳过
+    size_t skip = pending_;
+    appendCommand(args);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.timeoutMs);
+
+    while(true)
+    {
+        bool complete = false;
+        if(!nextReply(reply, complete))
+        {
+            fail("protocol error");
+            return false;
+        }
+        if(complete)
+        {
+            --pending_;
+            if(skip == 0)
+            {
+                return reply.type != Reply::kError;
+            }
+            if(!checkReply(reply))
+            {
+                fail("handshake failed");
+                return false;
+            }
+            --skip;
+            continue;
+        }
+
+        int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if(remaining <= 0)
+        {
+            fail("reply timeout");
+            return false;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = static_cast<short>(POLLIN | (output_.empty() ? 0 : POLLOUT));
+        pfd.revents = 0;
+        int n = ::poll(&pfd, 1, remaining);
+        if(n < 0 && errno != EINTR)
+        {
+            fail("poll failed", errno);
+            return false;
+        }
+        if((pfd.revents & POLLOUT) && !writeSome())
+        {
+            fail("write failed", errno);
+            return false;
+        }
+        if((pfd.revents & (POLLIN | POLLHUP | POLLERR)) && !readSome())
+        {
+            fail("connection closed by server");
+            return false;
+        }
+    }
+}
+
+bool RedisSessionStorage::Connection::ready()
+{
+    if(!loop_ && state_ == kDisconnected && std::chrono::steady_clock::now() >= nextAttempt_)
+    {
+        connect();
+    }
+    if(!loop_ && state_ == kConnecting)
+    {
+        // 没有 loop 替我们等连接完成，这里只看一眼，不等
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if(::poll(&pfd, 1, 0) > 0)
+        {
+            finishConnect();
+        }
+    }
+    return state_ == kConnected;
+}
+
+void RedisSessionStorage::Connection::finishConnect()
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if(::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+    {
+        fail("connect failed", error);
+        return;
+    }
+    onConnected();
+}
+
+void RedisSessionStorage::Connection::onConnected()
+{
+    int one = 1;
+    ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    state_ = kConnected;
+    backoffMs_ = std::max(config_.reconnectMinMs, 1);
+    if(channel_)
+    {
+        channel_->disableWriting();
+        channel_->enableReading();
+    }
+
+    LOG_INFO << "RedisSessionStorage: connected to " << config_.host << ":" << config_.port;
+    if(dropped_ > 0)
+    {
+        LOG_WARN << "RedisSessionStorage: " << dropped_ << " commands were dropped while disconnected";
+        dropped_ = 0;
+    }
+
+    // AUTH / SELECT 不等回复，和后面的命令一起流水线发出去，回复出错的时候断开重连
+    if(!config_.password.empty())
+    {
+        appendCommand({"AUTH", config_.password});
+        ++handshake_;
+    }
+    if(config_.database != 0)
+    {
+        appendCommand({"SELECT", std::to_string(config_.database)});
+        ++handshake_;
+    }
+    if(!writeSome())
+    {
+        fail("write failed", errno);
+    }
+}
+
+void RedisSessionStorage::Connection::fail(const char* what, int error)
+{
+    LOG_ERROR << "RedisSessionStorage: " << config_.host << ":" << config_.port << " " << what
+              << (error != 0 ? std::string(": ") + strerror(error) : std::string())
+              << ", reconnecting in " << backoffMs_ << "ms";
+    close();
+
+    int delay = backoffMs_;
+    backoffMs_ = std::min(backoffMs_ * 2, std::max(config_.reconnectMaxMs, delay));
+    if(loop_)
+    {
+        std::weak_ptr<Connection> weak = shared_from_this();
+        loop_->runAfter(delay / 1000.0, [weak] {
+            if(auto conn = weak.lock()) conn->connect();
+        });
+    }
+    else
+    {
+        nextAttempt_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+    }
+}
+
+void RedisSessionStorage::Connection::close()
+{
+    if(channel_)
+    {
+        channel_->disableAll();
+        channel_->remove();
+        if(loop_ && std::this_thread::get_id() == owner_)
+        {
+            // 可能正在这个 Channel 自己的回调里面，等这一轮事件处理完再析构
+            std::shared_ptr<muduo::net::Channel> channel(channel_.release());
+            loop_->queueInLoop([channel] {});
+        }
+        channel_.reset();
+    }
+    if(fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    state_ = kDisconnected;
+    output_.clear();
+    input_.clear();
+    inputPos_ = 0;
+    pending_ = 0;
+    handshake_ = 0;
+}
+
+void RedisSessionStorage::Connection::appendCommand(const std::vector<std::string>& args)
+{
+    // *<参数个数>\r\n 然后每个参数 $<长度>\r\n<内容>\r\n
+    output_ += '*';
+    output_ += std::to_string(args.size());
+    output_ += "\r\n";
+    for(const auto& arg : args)
+    {
+        output_ += '$';
+        output_ += std::to_string(arg.size());
+        output_ += "\r\n";
+        output_ += arg;
+        output_ += "\r\n";
+    }
+    ++pending_;
+}
+
+bool RedisSessionStorage::Connection::writeSome()
+{
+    size_t written = 0;
+    while(written < output_.size())
+    {
+        ssize_t n = ::write(fd_, output_.data() + written, output_.size() - written);
+        if(n > 0)
+        {
+            written += static_cast<size_t>(n);
+        }
+        else if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    output_.erase(0, written);
+
+    if(channel_)
+    {
+        // 发不完的等 socket 可写的时候由 loop 接着发
+        if(!output_.empty() && !channel_->isWriting())
+        {
+            channel_->enableWriting();
+        }
+        else if(output_.empty() && channel_->isWriting())
+        {
+            channel_->disableWriting();
+        }
+    }
+    return true;
+}
+
+bool RedisSessionStorage::Connection::readSome()
+{
+    // 解析过的部分超过一半的时候挪一下，避免缓冲区一直增长
+    if(inputPos_ > 0 && inputPos_ * 2 >= input_.size())
+    {
+        input_.erase(0, inputPos_);
+        inputPos_ = 0;
+    }
+
+    char buf[16384];
+    while(true)
+    {
+        ssize_t n = ::read(fd_, buf, sizeof(buf));
+        if(n > 0)
+        {
+            input_.append(buf, static_cast<size_t>(n));
+            if(static_cast<size_t>(n) < sizeof(buf))
+            {
+                return true;
+            }
+        }
+        else if(n == 0)
+        {
+            return false;
+        }
+        else if(errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+bool RedisSessionStorage::Connection::nextReply(Reply& reply, bool& complete)
+{
+    // 返回解析的字节数，0 表示数据还不完整，-1 表示格式错误
+    struct Parser
+    {
+        static ssize_t parse(const char* begin, const char* end, Reply& out)
+        {
+            if(begin >= end)
+            {
+                return 0;
+            }
+            const char* crlf = nullptr;
+            for(const char* p = begin + 1; p + 1 < end; ++p)
+            {
+                if(p[0] == '\r' && p[1] == '\n')
+                {
+                    crlf = p;
+                    break;
+                }
+            }
+            if(!crlf)
+            {
+                return 0;
+            }
+
+            const char* line = begin + 1;
+            const char* next = crlf + 2;
+            bool ok = true;
+            switch(*begin)
+            {
+            case '+':
+            case '-':
+                out.type = *begin == '+' ? Reply::kString : Reply::kError;
+                out.str.assign(line, crlf);
+                return next - begin;
+            case ':':
+                out.type = Reply::kInteger;
+                out.integer = parseInteger(line, crlf, ok);
+                return ok ? next - begin : -1;
+            case '$':
+            {
+                int64_t len = parseInteger(line, crlf, ok);
+                if(!ok)
+                {
+                    return -1;
+                }
+                if(len < 0)
+                {
+                    out.type = Reply::kNil;
+                    return next - begin;
+                }
+                if(end - next < len + 2)
+                {
+                    return 0;
+                }
+                if(next[len] != '\r' || next[len + 1] != '\n')
+                {
+                    return -1;
+                }
+                out.type = Reply::kString;
+                out.str.assign(next, static_cast<size_t>(len));
+                return next + len + 2 - begin;
+            }
+            case '*':
+            {
+                int64_t count = parseInteger(line, crlf, ok);
+                if(!ok)
+                {
+                    return -1;
+                }
+                out.type = count < 0 ? Reply::kNil : Reply::kArray;
+                out.elements.clear();
+                for(int64_t i = 0; i < count; ++i)
+                {
+                    out.elements.emplace_back();
+                    ssize_t used = parse(next, end, out.elements.back());
+                    if(used <= 0)
+                    {
+                        return used;
+                    }
+                    next += used;
+                }
+                return next - begin;
+            }
+            default:
+                return -1;
+            }
+        }
+    };
+
+    ssize_t used = Parser::parse(input_.data() + inputPos_, input_.data() + input_.size(), reply);
+    if(used < 0)
+    {
+        LOG_ERROR << "RedisSessionStorage: protocol error";
+        return false;
+    }
+    complete = used > 0;
+    inputPos_ += static_cast<size_t>(used);
+    return true;
+}
+
+void RedisSessionStorage::Connection::drainReplies()
+{
+    while(pending_ > 0)
+    {
+        Reply reply;
+        bool complete = false;
+        if(!nextReply(reply, complete))
+        {
+            fail("protocol error");
+            return;
+        }
+        if(!complete)
+        {
+            return;
+        }
+        --pending_;
+        if(!checkReply(reply))
+        {
+            fail("handshake failed");
+            return;
+        }
+    }
+}
+
+bool RedisSessionStorage::Connection::checkReply(const Reply& reply)
+{
+    bool handshake = handshake_ > 0;
+    if(handshake)
+    {
+        --handshake_;
+    }
+    if(reply.type != Reply::kError)
+    {
+        return true;
+    }
+    LOG_ERROR << "RedisSessionStorage: " << reply.str;
+    return !handshake;
+}
+
+void RedisSessionStorage::Connection::handleRead()
+{
+    // 同一轮事件里面前面的回调可能已经断开了
+    if(state_ != kConnected)
+    {
+        return;
+    }
+    if(!readSome())
+    {
+        fail("connection closed by server");
+        return;
+    }
+    drainReplies();
+}
+
+void RedisSessionStorage::Connection::handleWrite()
+{
+    if(state_ == kConnecting)
+    {
+        finishConnect();
+    }
+    else if(state_ == kConnected && !writeSome())
+    {
+        fail("write failed", errno);
+    }
+}
+
+void RedisSessionStorage::Connection::handleError()
+{
+    if(state_ == kDisconnected)
+    {
+        return;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    ::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len);
+    fail(state_ == kConnecting ? "connect failed" : "socket error", error);
+}
+
+} // namespace session
+} // namespace http
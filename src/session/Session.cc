@@ -9,6 +9,9 @@ namespace session
 
 Session::Session(const std::string& sessionId, SessionManager* SessionManager, int maxAge)
     : sessionId_(sessionId)
+    , created_(true)
+    , touched_(false)
+    , expiryTime_(0)
     , maxAge_(maxAge)
     , sessionManager_(SessionManager)
 {
@@ -17,26 +20,39 @@ Session::Session(const std::string& sessionId, SessionManager* SessionManager, i
 
 bool Session::isExpired() const
 {
-    return std::chrono::system_clock::now() > expiryTime_;
+    return Clock::now().time_since_epoch().count() > expiryTime_.load(std::memory_order_relaxed);
 }
 
 void Session::refresh()
 {
-    expiryTime_ = std::chrono::system_clock::now() + std::chrono::seconds(maxAge_);
+    Clock::time_point expiry = Clock::now() + std::chrono::seconds(maxAge_);
+    expiryTime_.store(expiry.time_since_epoch().count(), std::memory_order_relaxed);
+    touched_.store(true, std::memory_order_relaxed);
 }
 
-void Session::setValue(const std::string& key, const std::string& value)
+size_t Session::approximateSize() const
 {
-    data_[key] = value;
-    // 如果设置了 manager， 自动保存更改
-    if(sessionManager_)
+    // 加上对象本身和哈希表节点的开销，只需要数量级准确
+    size_t size = sizeof(Session) + sessionId_.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(const auto& item : data_)
     {
-        sessionManager_->updateSession(shared_from_this());
+        size += item.first.size() + item.second.size() + 64;
     }
+    return size;
+}
+
+void Session::setValue(const std::string& key, const std::string& value)
+{
+    // 以前每次 setValue 都会写一次存储，现在只记下来，请求结束的时候 SessionManager 一次写回
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_[key] = value;
+    dirtyKeys_.insert(key);
 }
 
 std::string Session::getValue(const std::string& key) const
 {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = data_.find(key);
     return it != data_.end()? it->second : std::string();
 }
@@ -44,14 +60,64 @@ std::string Session::getValue(const std::string& key) const
 // 删除会话数据
 void Session::remove(const std::string& key)
 {
-    data_.erase(key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(data_.erase(key))
+    {
+        dirtyKeys_.insert(key);
+    }
 }
 
 // 清空会话数据
 void Session::clear()
 {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(const auto& item : data_)
+    {
+        dirtyKeys_.insert(item.first);
+    }
     data_.clear();
 }
 
+void Session::restore(std::unordered_map<std::string, std::string> data, Clock::time_point expiry)
+{
+    expiryTime_.store(expiry.time_since_epoch().count(), std::memory_order_relaxed);
+    touched_.store(false, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_ = std::move(data);
+    dirtyKeys_.clear();
+    created_ = false;
+}
+
+std::unordered_map<std::string, std::string> Session::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return data_;
+}
+
+SessionChanges Session::takeChanges()
+{
+    SessionChanges changes;
+    changes.touched = touched_.exchange(false, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    changes.created = created_;
+    created_ = false;
+    for(const auto& key : dirtyKeys_)
+    {
+        auto it = data_.find(key);
+        if(it != data_.end())
+        {
+            changes.updated.emplace(key, it->second);
+        }
+        else
+        {
+            changes.removed.push_back(key);
+        }
+    }
+    dirtyKeys_.clear();
+    return changes;
+}
+
 }   // namespace session
 }   // namespace http
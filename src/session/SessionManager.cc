@@ -1,103 +1,336 @@
 #include "../../include/session/SessionManager.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <stdexcept>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#include <muduo/base/Logging.h>
 
 namespace http
 {
 namespace session
 {
+
+namespace
+{
+
+struct PendingSession
+{
+    SessionManager*             manager;
+    std::shared_ptr<Session>    session;
+    HttpResponse*               response;   // 无状态模式在这个响应上写回 cookie
+    bool                        destroyed;  // 这次请求销毁了会话：有存储的时候不再写回，无状态模式下要清掉 cookie
+};
+
+// 请求是在 IO 线程上同步处理的，这次请求里面用到的会话记在线程局部的列表里面，
+// 处理完之后一起写回，不需要在请求对象上挂额外的状态
+thread_local std::vector<PendingSession> pendingSessions;
+
+const size_t kSessionIdBytes = 16;
+const size_t kRandomBufferSize = 4096;     // 一次取 256 个会话 id 的随机数
+
+// 一个字节对应的两个十六进制字符
+struct HexTable
+{
+    char pairs[256][2];
+
+    HexTable()
+    {
+        const char digits[] = "0123456789abcdef";
+        for(int i = 0; i < 256; ++i)
+        {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0xF];
+        }
+    }
+
+    const char* operator[](unsigned char byte) const { return pairs[byte]; }
+};
+
+const HexTable kHexTable;
+
+// fork 之后子进程不能继续用父进程缓冲区里面剩下的随机数，否则两边会生成同样的 id，
+// 子进程里面把代数加一，每个线程发现代数变了就重新取
+std::atomic<unsigned> forkGeneration{0};
+
+const int kAtForkRegistered = ::pthread_atfork(nullptr, nullptr, [] {
+    forkGeneration.fetch_add(1, std::memory_order_relaxed);
+});
+
+// 每个线程一块随机数缓冲区，用完之后一次从 RAND_bytes 取满，不需要加锁，系统调用也摊到很多个 id 上
+struct RandomBuffer
+{
+    unsigned char   bytes[kRandomBufferSize];
+    size_t          pos = kRandomBufferSize;
+    unsigned        generation = 0;
+};
+
+thread_local RandomBuffer randomBuffer;
+
+void fillRandom(unsigned char* buffer, size_t len)
+{
+    if(RAND_bytes(buffer, static_cast<int>(len)) == 1)
+    {
+        return;
+    }
+
+    // OpenSSL 的随机数生成器出问题的时候直接从内核取
+    LOG_WARN << "SessionManager: RAND_bytes failed, falling back to getrandom";
+    size_t filled = 0;
+    while(filled < len)
+    {
+        ssize_t n = ::getrandom(buffer + filled, len - filled, 0);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            // 没有安全的随机数的时候不能生成会话 id，宁可让请求失败
+            throw std::runtime_error("SessionManager: no secure random source available");
+        }
+        filled += static_cast<size_t>(n);
+    }
+}
+
+void randomBytes(unsigned char* out, size_t len)
+{
+    RandomBuffer& buffer = randomBuffer;
+    unsigned generation = forkGeneration.load(std::memory_order_relaxed);
+    if(buffer.pos + len > kRandomBufferSize || buffer.generation != generation)
+    {
+        fillRandom(buffer.bytes, kRandomBufferSize);
+        buffer.pos = 0;
+        buffer.generation = generation;
+    }
+
+    // 取走的随机数在缓冲区里面清零，进程内存泄露的时候也拿不到已经发出去的 id
+    std::memcpy(out, buffer.bytes + buffer.pos, len);
+    OPENSSL_cleanse(buffer.bytes + buffer.pos, len);
+    buffer.pos += len;
+}
+
+} // namespace
     
 SessionManager::SessionManager(std::unique_ptr<SessionStorage> storage)
     : storage_(std::move(storage))
-    , rng_(std::random_device{}()) // 初始化随机数生成，用于生成随机的会话
+    , cookieName_("sessionId")
+{}
+
+SessionManager::SessionManager(const CookieSessionConfig& config)
+    : codec_(new CookieSessionCodec(config))
+    , cookieName_(config.cookieName)
 {}
 
 // 从请求中获取或创建会话
 // 也就是说，如果请求中包含会话ID，则从存储中加载会话，否则创建一个新的会话
 std::shared_ptr<Session> SessionManager::getSession(const HttpRequest& req, HttpResponse* resp)
 {
-    std::string sessionId = getSessionIdFromCookie(req);
     std::shared_ptr<Session> session;
+    if(codec_)
+    {
+        // 新建的会话没有 cookie，请求结束的时候 flushSessions 里面签发
+        session = loadFromCookie(req);
+        if(!session)
+        {
+            session = std::make_shared<Session>(generateSessionId(), this, codec_->config().maxAge);
+        }
+        session->setManager(this);
+    }
+    else
+    {
+        std::string sessionId = getSessionIdFromCookie(req);
+        if(!sessionId.empty())
+        {
+            session = storage_->load(sessionId);
+        }
 
-    if(!sessionId.empty())
+        if(!session || session->isExpired())
+        {
+            sessionId = generateSessionId();
+            session = std::make_shared<Session>(sessionId, this);
+            setSessionCookie(sessionId, resp);
+        }
+        else
+        {
+            session->setManager(this);  // 否则就是找到了，为现有会话设置管理器
+        }
+
+        // 只刷新内存里面的过期时间，存储在请求结束的时候 flushSessions 里面一次写回
+        session->refresh();
+    }
+
+    bool pending = false;
+    for(const auto& item : pendingSessions)
     {
-        session = storage_->load(sessionId);
+        pending = pending || (item.manager == this && item.session == session);
     }
+    if(!pending)
+    {
+        pendingSessions.push_back(PendingSession{this, session, resp, false});
+    }
+    return session;
+}
 
-    if(!session || session->isExpired())
+void SessionManager::flushSessions()
+{
+    if(pendingSessions.empty())
     {
-        sessionId = generateSessionId();
-        session = std::make_shared<Session>(sessionId, this);
-        setSessionCookie(sessionId, resp);
+        return;
     }
-    else
+
+    std::vector<PendingSession> sessions;
+    sessions.swap(pendingSessions);
+    for(auto& item : sessions)
     {
-        session->setManager(this);  // 否则就是找到了，为现有会话设置管理器
+        if(item.manager != this)
+        {
+            // 没有装到 HttpServer 上的管理器永远不会被调用 flushSessions，留着的话列表会一直变长，
+            // 还会拿着已经发出去的响应的指针，请求结束的时候直接丢掉
+            static std::atomic<bool> warned{false};
+            if(!warned.exchange(true))
+            {
+                LOG_WARN << "SessionManager: session from a manager not installed on HttpServer is not saved";
+            }
+            continue;
+        }
+        SessionChanges changes = item.session->takeChanges();
+        if(codec_)
+        {
+            if(item.destroyed || !changes.empty())
+            {
+                writeCookie(*item.session, item.destroyed, item.response);
+            }
+        }
+        else if(!item.destroyed && !changes.empty())
+        {
+            // 这次请求里面销毁了的会话已经从存储删除，不能再写回去，否则退出登录不会生效
+            storage_->flush(item.session, changes);
+        }
     }
+}
 
-    session->refresh();
-    storage_->save(session);
-    return session;
+void SessionManager::discardPendingSessions()
+{
+    pendingSessions.clear();
 }
 
 // 生成唯一的会话标识符，确保会话的唯一性和安全性
+// 会话 id 就是登录凭证，必须不可预测，所以用操作系统的 CSPRNG 而不是 mt19937
 std::string SessionManager::generateSessionId()
 {
-    std::stringstream ss;
-    std::uniform_int_distribution<> dist(0, 15);
-
-    // 生成32个字符的会话ID，每个字符是一个十六进制数字
-    for(int i=0; i<32; ++i)
+    unsigned char bytes[kSessionIdBytes];
+    randomBytes(bytes, kSessionIdBytes);
+    std::string sessionId(kSessionIdBytes * 2, '\0');
+    for(size_t i = 0; i < kSessionIdBytes; ++i)
     {
-        ss << std::hex << dist(rng_);
+        const char* hex = kHexTable[bytes[i]];
+        sessionId[2 * i] = hex[0];
+        sessionId[2 * i + 1] = hex[1];
     }
-    return ss.str();
+    return sessionId;
 }
 
 // 销毁会话
 void SessionManager::destorySession(const std::string& sessionId)
 {
-    storage_->remove(sessionId);
-}   
+    // 两种模式都要标记这次请求里面拿到的会话，flushSessions 的时候不再写回
+    bool found = false;
+    for(auto& item : pendingSessions)
+    {
+        if(item.manager == this && item.session->getId() == sessionId)
+        {
+            item.destroyed = true;
+            found = true;
+        }
+    }
+
+    if(storage_)
+    {
+        storage_->remove(sessionId);
+        return;
+    }
+    if(!found)
+    {
+        LOG_WARN << "SessionManager: cookie session " << sessionId << " was not loaded by this request, cannot destroy it";
+    }
+}
 
 // 清理过期会话
 void SessionManager::cleanExpiredSessions()
 {
-    // 注意：这个实现依赖于具体的存储实现
-    // 对于内存存储，可以在加载时检查是否过期
-    // 对于其它存储的实现，可能需要定期清理过期会话
+    // HttpServer 启动之后定时调用，每次只清理一小批，具体怎么清理由存储决定
+    // 无状态模式下会话只在 cookie 里面，过期的 cookie 在 decode 的时候就被拒绝了
+    if(storage_)
+    {
+        storage_->cleanExpired();
+    }
 }
 
 std::string SessionManager::getSessionIdFromCookie(const HttpRequest& req)
 {
-    std::string sessionId;
-    std::string cookie = req.getHeader("Cookie");
+    // 名字完整匹配，xsessionId 不会被当成 sessionId
+    std::string_view sessionId;
+    req.getCookie(cookieName_, sessionId);
+    return std::string(sessionId);
+}
+
+void SessionManager::setSessionCookie(const std::string& sessionId, HttpResponse* resp)
+{
+    // 设置会话ID到相应头中， 作为Cookie
+    std::string cookie = cookieName_ + "=" + sessionId + "; Path=/; HttpOnly";
+    resp->addHeader("Set-Cookie", cookie);
+}
 
-    if(!cookie.empty())
+std::shared_ptr<Session> SessionManager::loadFromCookie(const HttpRequest& req)
+{
+    std::string value = getSessionIdFromCookie(req);
+    if(value.empty())
     {
-        size_t pos = cookie.find("sessionId=");
-        if(pos != std::string::npos)
-        {
-            pos += 10;  // 跳过 "sessionId="
-            size_t end = cookie.find(';', pos);
-            if(end != std::string::npos)
-            {
-                sessionId = cookie.substr(pos, end-pos);
-            }
-            else{
-                sessionId = cookie.substr(pos);
-            }
-        }
+        return nullptr;
     }
 
-    return sessionId;
+    bool rotated = false;
+    std::shared_ptr<Session> session = codec_->decode(value, rotated);
+    if(!session)
+    {
+        return nullptr;
+    }
+
+    // 不是每个请求都重新签发 cookie：剩下的有效期不到一半，或者是用旧密钥签发的，
+    // 才刷新过期时间，请求结束的时候重新签发
+    auto remaining = session->expiryTime() - Session::Clock::now();
+    if(rotated || remaining < std::chrono::seconds(codec_->config().maxAge) / 2)
+    {
+        session->refresh();
+    }
+    return session;
 }
 
-void SessionManager::setSessionCookie(const std::string& sessionId, HttpResponse* resp)
+void SessionManager::writeCookie(Session& session, bool destroyed, HttpResponse* resp)
 {
-    // 设置会话ID到相应头中， 作为Cookie
-    std::string cookie = "sessionId=" + sessionId + "; Path=/; HttpOnly";
-    resp->addHeader("Set-Cookie", cookie);
+    if(!resp)
+    {
+        return;
+    }
+    if(destroyed)
+    {
+        resp->addHeader("Set-Cookie", cookieName_ + "=; Path=/; HttpOnly; Max-Age=0");
+        return;
+    }
+
+    // 编码失败(会话太大)的时候不写，客户端继续用原来的 cookie
+    std::string value = codec_->encode(session);
+    if(!value.empty())
+    {
+        setSessionCookie(value, resp);
+    }
 }
 
 } // namespace session
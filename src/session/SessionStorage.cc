@@ -1,30 +1,175 @@
 #include "../../include/session/SessionStorage.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <muduo/base/Logging.h>
 
 namespace http
 {
 namespace session
 {
+
+namespace
+{
+
+// 快照文件的格式，整数都是本机字节序(快照只在同一台机器上恢复)：
+//      文件头：8 字节 magic，8 字节记录数
+//      每条记录：8 字节过期时间(Unix 毫秒)，4 字节记录内容的长度，然后是记录内容：
+//          id，4 字节字段数，每个字段的 key 和 value；字符串都是 4 字节长度加内容
+// 过期时间和长度放在前面，恢复的时候过期的记录不用解析就能跳过
+const char kSnapshotMagic[8] = {'H', 'S', 'E', 'S', 'S', 'N', 'P', '1'};
+const size_t kSnapshotHeaderSize = sizeof(kSnapshotMagic) + sizeof(uint64_t);
+const size_t kSnapshotWriteChunk = 1 << 20;
+
+template <typename T>
+void appendPod(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& out, const std::string& value)
+{
+    appendPod(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+// 在 mmap 进来的快照里面顺序读，越界的时候返回 false
+struct SnapshotReader
+{
+    const char* pos;
+    const char* end;
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if(static_cast<size_t>(end - pos) < sizeof(T))
+        {
+            return false;
+        }
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string& value)
+    {
+        uint32_t len = 0;
+        if(!read(len) || static_cast<size_t>(end - pos) < len)
+        {
+            return false;
+        }
+        value.assign(pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+bool writeFully(int fd, const std::string& data)
+{
+    size_t written = 0;
+    while(written < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int64_t toMillis(Session::Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+MemorySessionStorage::MemorySessionStorage(const MemorySessionConfig& config)
+    : config_(config)
+    , running_(false)
+{
+    if(!config_.snapshotPath.empty())
+    {
+        restoreSnapshot();
+        running_ = true;
+        snapshotThread_ = std::thread(&MemorySessionStorage::snapshotLoop, this);
+    }
+}
+
+MemorySessionStorage::~MemorySessionStorage()
+{
+    if(snapshotThread_.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex_);
+            running_ = false;
+        }
+        snapshotCond_.notify_one();
+        snapshotThread_.join();
+        writeSnapshot();
+    }
+}
     
 void MemorySessionStorage::save(std::shared_ptr<Session> session)
 {
-    // 创建会话副本并存储
-    sessions_[session->getId()] = session;
+    // 大小在锁外面算，要拿会话自己的锁
+    size_t bytes = session->approximateSize();
+    Session::Clock::rep expiry = session->expiryTime().time_since_epoch().count();
+
+    // 存的是共享指针，同一个会话在所有线程上都是同一个对象
+    Shard& shard = shardFor(session->getId());
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(session->getId());
+    if(it == shard.sessions.end())
+    {
+        const std::string& sessionId = session->getId();
+        it = shard.sessions.emplace(sessionId, Entry{nullptr, bytes, {}}).first;
+        it->second.session = std::move(session);
+        shard.lru.push_front(&it->first);
+        it->second.lruIt = shard.lru.begin();
+        pushExpiry(shard, expiry, it->first);
+    }
+    else
+    {
+        // 刷新过期时间不用动堆，清理的时候发现没到期会按新的时间放回去
+        shard.bytes -= it->second.bytes;
+        it->second.session = std::move(session);
+        it->second.bytes = bytes;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruIt);
+    }
+    shard.bytes += bytes;
+    evictLocked(shard);
 }
 
 // 通过会话ID从存储中加载会话
 std::shared_ptr<Session> MemorySessionStorage::load(const std::string& sessionId)
 {
-    auto it = sessions_.find(sessionId);
-    if(it != sessions_.end())
+    Shard& shard = shardFor(sessionId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(sessionId);
+    if(it != shard.sessions.end())
     {
-        if(!it->second->isExpired())
+        if(!it->second.session->isExpired())
         {
-            return it->second;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruIt);
+            return it->second.session;
         }
         else{
             // 如果会话已经过期，则从存储中移除
-            sessions_.erase(it);
+            eraseLocked(shard, it);
         }
     }
     // 如果会话不存在或者已经过期了，我们就返回 nullptr
@@ -33,7 +178,314 @@ std::shared_ptr<Session> MemorySessionStorage::load(const std::string& sessionId
 
 void MemorySessionStorage::remove(const std::string& sessionId)
 {
-    sessions_.erase(sessionId);
+    Shard& shard = shardFor(sessionId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(sessionId);
+    if(it != shard.sessions.end())
+    {
+        eraseLocked(shard, it);
+    }
+}
+
+void MemorySessionStorage::flush(std::shared_ptr<Session> session, const SessionChanges& changes)
+{
+    // 存的就是这个对象，只刷新了过期时间的话不需要做任何事；数据改了要重新算占用的内存
+    if(changes.dataChanged())
+    {
+        save(std::move(session));
+    }
+}
+
+void MemorySessionStorage::cleanExpired()
+{
+    auto greater = std::greater<ExpiryEntry>();
+    for(auto& shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Session::Clock::rep now = Session::Clock::now().time_since_epoch().count();
+
+        // 每个分片只处理一小批，IO 线程等这把锁的时间是有上限的，剩下的下次再清理
+        for(size_t i = 0; i < config_.sweepBatch && !shard.expiry.empty() && shard.expiry.front().first <= now; ++i)
+        {
+            std::pop_heap(shard.expiry.begin(), shard.expiry.end(), greater);
+            ExpiryEntry top = std::move(shard.expiry.back());
+            shard.expiry.pop_back();
+
+            auto it = shard.sessions.find(top.second);
+            if(it == shard.sessions.end())
+            {
+                continue;   // 已经删除或者淘汰了
+            }
+            Session::Clock::rep expiry = it->second.session->expiryTime().time_since_epoch().count();
+            if(expiry <= now)
+            {
+                eraseLocked(shard, it);
+            }
+            else if(expiry != top.first)
+            {
+                // 中途被刷新过，按新的过期时间放回去
+                pushExpiry(shard, expiry, it->first);
+            }
+        }
+
+        // 删除和淘汰的会话在堆里面留下的旧条目太多的时候，重建一次，保证堆的大小和会话数量是同一个量级
+        if(shard.expiry.size() > shard.sessions.size() * 2 + 64)
+        {
+            shard.expiry.clear();
+            for(const auto& item : shard.sessions)
+            {
+                shard.expiry.emplace_back(item.second.session->expiryTime().time_since_epoch().count(), item.first);
+            }
+            std::make_heap(shard.expiry.begin(), shard.expiry.end(), greater);
+        }
+    }
+}
+
+size_t MemorySessionStorage::size() const
+{
+    size_t count = 0;
+    for(const auto& shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        count += shard.sessions.size();
+    }
+    return count;
+}
+
+size_t MemorySessionStorage::bytes() const
+{
+    size_t total = 0;
+    for(const auto& shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+bool MemorySessionStorage::writeSnapshot()
+{
+    if(config_.snapshotPath.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> writeLock(writeMutex_);
+    std::string tmpPath = config_.snapshotPath + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0)
+    {
+        LOG_ERROR << "MemorySessionStorage: cannot open " << tmpPath << ": " << strerror(errno);
+        return false;
+    }
+
+    // 记录数先写 0，写完之后再回来改
+    std::string buffer(kSnapshotMagic, sizeof(kSnapshotMagic));
+    appendPod(buffer, static_cast<uint64_t>(0));
+
+    uint64_t count = 0;
+    bool ok = true;
+    int64_t now = toMillis(Session::Clock::now());
+    std::vector<std::shared_ptr<Session>> sessions;
+    for(auto& shard : shards_)
+    {
+        // 分片的锁里面只拿共享指针，IO 线程最多等这一小会，会话内容在锁外面按各自的锁读
+        sessions.clear();
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            sessions.reserve(shard.sessions.size());
+            for(const auto& item : shard.sessions)
+            {
+                sessions.push_back(item.second.session);
+            }
+        }
+
+        for(const auto& session : sessions)
+        {
+            int64_t expires = toMillis(session->expiryTime());
+            if(expires <= now)
+            {
+                continue;
+            }
+            std::unordered_map<std::string, std::string> data = session->snapshot();
+            size_t length = sizeof(uint32_t) + session->getId().size() + sizeof(uint32_t);
+            for(const auto& item : data)
+            {
+                length += 2 * sizeof(uint32_t) + item.first.size() + item.second.size();
+            }
+
+            appendPod(buffer, expires);
+            appendPod(buffer, static_cast<uint32_t>(length));
+            appendString(buffer, session->getId());
+            appendPod(buffer, static_cast<uint32_t>(data.size()));
+            for(const auto& item : data)
+            {
+                appendString(buffer, item.first);
+                appendString(buffer, item.second);
+            }
+            ++count;
+        }
+
+        if(buffer.size() >= kSnapshotWriteChunk)
+        {
+            ok = ok && writeFully(fd, buffer);
+            buffer.clear();
+        }
+    }
+
+    ok = ok && writeFully(fd, buffer)
+        && ::pwrite(fd, &count, sizeof(count), sizeof(kSnapshotMagic)) == static_cast<ssize_t>(sizeof(count))
+        && ::fsync(fd) == 0;
+    int savedErrno = errno;
+    ::close(fd);
+    if(!ok || ::rename(tmpPath.c_str(), config_.snapshotPath.c_str()) != 0)
+    {
+        LOG_ERROR << "MemorySessionStorage: writing snapshot " << config_.snapshotPath << " failed: "
+                  << strerror(ok ? errno : savedErrno);
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    LOG_DEBUG << "MemorySessionStorage: wrote " << count << " sessions to " << config_.snapshotPath;
+    return true;
+}
+
+size_t MemorySessionStorage::restoreSnapshot()
+{
+    int fd = ::open(config_.snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        if(errno != ENOENT)
+        {
+            LOG_ERROR << "MemorySessionStorage: cannot open snapshot " << config_.snapshotPath << ": " << strerror(errno);
+        }
+        return 0;
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kSnapshotHeaderSize)
+    {
+        ::close(fd);
+        LOG_WARN << "MemorySessionStorage: snapshot " << config_.snapshotPath << " is empty or truncated, ignored";
+        return 0;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED)
+    {
+        LOG_ERROR << "MemorySessionStorage: mmap snapshot " << config_.snapshotPath << " failed: " << strerror(errno);
+        return 0;
+    }
+    ::madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const char* begin = static_cast<const char*>(mapped);
+    SnapshotReader reader{begin + sizeof(kSnapshotMagic), begin + size};
+    uint64_t count = 0;
+    if(std::memcmp(begin, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 || !reader.read(count))
+    {
+        ::munmap(mapped, size);
+        LOG_WARN << "MemorySessionStorage: " << config_.snapshotPath << " is not a session snapshot, ignored";
+        return 0;
+    }
+
+    size_t restored = 0;
+    size_t skipped = 0;
+    bool corrupted = false;
+    int64_t now = toMillis(Session::Clock::now());
+    for(uint64_t i = 0; i < count && !corrupted; ++i)
+    {
+        int64_t expires = 0;
+        uint32_t length = 0;
+        if(!reader.read(expires) || !reader.read(length) || static_cast<size_t>(reader.end - reader.pos) < length)
+        {
+            corrupted = true;
+            break;
+        }
+
+        SnapshotReader record{reader.pos, reader.pos + length};
+        reader.pos += length;
+        if(expires <= now)
+        {
+            ++skipped;
+            continue;
+        }
+
+        std::string sessionId;
+        uint32_t fields = 0;
+        std::unordered_map<std::string, std::string> data;
+        corrupted = !record.readString(sessionId) || !record.read(fields);
+        for(uint32_t j = 0; j < fields && !corrupted; ++j)
+        {
+            std::string key;
+            std::string value;
+            corrupted = !record.readString(key) || !record.readString(value);
+            data.emplace(std::move(key), std::move(value));
+        }
+        if(!corrupted)
+        {
+            auto session = std::make_shared<Session>(sessionId, nullptr);
+            session->restore(std::move(data), Session::Clock::time_point(
+                std::chrono::duration_cast<Session::Clock::duration>(std::chrono::milliseconds(expires))));
+            save(std::move(session));
+            ++restored;
+        }
+    }
+    ::munmap(mapped, size);
+
+    if(corrupted)
+    {
+        LOG_WARN << "MemorySessionStorage: snapshot " << config_.snapshotPath << " is corrupted, restored the first "
+                 << restored << " sessions";
+    }
+    LOG_INFO << "MemorySessionStorage: restored " << restored << " sessions from " << config_.snapshotPath
+             << ", skipped " << skipped << " expired";
+    return restored;
+}
+
+void MemorySessionStorage::snapshotLoop()
+{
+    std::unique_lock<std::mutex> lock(snapshotMutex_);
+    while(running_)
+    {
+        if(snapshotCond_.wait_for(lock, std::chrono::seconds(config_.snapshotIntervalSeconds), [this] { return !running_; }))
+        {
+            break;
+        }
+        lock.unlock();
+        writeSnapshot();
+        lock.lock();
+    }
+}
+
+MemorySessionStorage::Shard& MemorySessionStorage::shardFor(const std::string& sessionId)
+{
+    return shards_[std::hash<std::string>()(sessionId) % kShardCount];
+}
+
+void MemorySessionStorage::eraseLocked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it)
+{
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lruIt);
+    shard.sessions.erase(it);
+}
+
+void MemorySessionStorage::evictLocked(Shard& shard)
+{
+    // 每个分片分到总上限的 1/kShardCount，总数不会超过上限；
+    // 上限比分片数还小的时候每个分片至少留一个，这时候最多有 kShardCount 个
+    size_t maxSessions = std::max<size_t>(config_.maxSessions / kShardCount, 1);
+    size_t maxBytes = config_.maxBytes / kShardCount;
+    // 至少留下刚保存的那一个(在 LRU 的最前面)，单个会话比分片的内存上限还大的时候也一样
+    while(shard.sessions.size() > 1 && (shard.sessions.size() > maxSessions || shard.bytes > maxBytes))
+    {
+        eraseLocked(shard, shard.sessions.find(*shard.lru.back()));
+    }
+}
+
+void MemorySessionStorage::pushExpiry(Shard& shard, Session::Clock::rep when, const std::string& sessionId)
+{
+    shard.expiry.emplace_back(when, sessionId);
+    std::push_heap(shard.expiry.begin(), shard.expiry.end(), std::greater<ExpiryEntry>());
 }
 
 } // namespace session
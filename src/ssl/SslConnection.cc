@@ -1,4 +1,5 @@
 #include "../../include/ssl/SslConnection.h"
+#include "../../include/metrics/Metrics.h"
 #include <muduo/base/Logging.h>
 #include <openssl/err.h>
 
@@ -135,10 +136,13 @@ void SslConnection::onRead(const TcpConnectionPtr& conn, BufferPtr buf, muduo::T
         // 握手阶段：SSL 引擎会从 readBio 里读取握手包进行处理
         handleHandShake();
         // 【更新】 handleHandShake里面现在会调用 sendRetrievedData，所以这里不管
-    } else if (state_ == SSLState::ESTABLISHED) {
+    }
+
+    // 握手可能就在上面完成，客户端的第一个请求经常和握手的最后一个包一起到达(已经在 readBio_ 里面)，
+    // 这时候不会再有新的网络数据触发 onRead，要接着在这里解密
+    if (state_ == SSLState::ESTABLISHED) {
         // 通信阶段：循环解密数据
         char decryptedData[4096];
-        muduo::net::Buffer decryptedBuffer;
         bool hasData = false;
 
         while (true) {
@@ -147,7 +151,8 @@ void SslConnection::onRead(const TcpConnectionPtr& conn, BufferPtr buf, muduo::T
 
             if (ret > 0) {
                 // 读到了解密后的数据
-                decryptedBuffer.append(decryptedData, ret);
+                // 解密的数据放到成员缓冲区里面，上层没解析完的半个请求下次还能接着用
+                decryptedBuffer_.append(decryptedData, ret);
                 hasData = true;
             } else {
                 // ret <= 0 说明 BIO 里没有完整的应用层数据包了，或者出错了
@@ -169,7 +174,7 @@ void SslConnection::onRead(const TcpConnectionPtr& conn, BufferPtr buf, muduo::T
 
         // 如果解密出了数据，回调给用户
         if (hasData && messageCallback_) {
-            messageCallback_(conn, &decryptedBuffer, time);
+            messageCallback_(conn, &decryptedBuffer_, time);
         }
 
         // 【修复】 即使在已连接状态，OpenSSL 也可能会产生一些协议数据，必须检查并发送
@@ -188,6 +193,10 @@ void SslConnection::handleHandShake()
     if(ret == 1)
     {
         state_ = SSLState::ESTABLISHED;
+        if(http::metrics::MetricsRegistry::getInstance().enabled())
+        {
+            http::metrics::MetricsRegistry::getInstance().local().tlsHandshakes.add();
+        }
         LOG_INFO << "SSL handshake completed successfully";
         LOG_INFO << "Using cipher: " << SSL_get_cipher(ssl_);  // 加密套文
         LOG_INFO << "Protocol version: " << SSL_get_version(ssl_);
@@ -215,6 +224,10 @@ void SslConnection::handleHandShake()
             unsigned long errCode = ERR_get_error();
             ERR_error_string_n(errCode, errBuf, sizeof errBuf);
             LOG_ERROR << "SSL handshake failed: " << errBuf;
+            if(http::metrics::MetricsRegistry::getInstance().enabled())
+            {
+                http::metrics::MetricsRegistry::getInstance().local().tlsHandshakeFailures.add();
+            }
             conn_->shutdown(); // 关闭连接
             break;
         }
@@ -0,0 +1,302 @@
+#include "../../include/trace/Tracer.h"
+#include "../../include/utils/JsonUtil.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include <muduo/base/Logging.h>
+#include <muduo/base/Timestamp.h>
+
+namespace http
+{
+namespace trace
+{
+
+namespace
+{
+
+// 每个线程一个随机数生成器，生成 id 的时候不需要加锁
+template <size_t N>
+void randomId(std::array<uint8_t, N>& id)
+{
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    do
+    {
+        for(size_t i = 0; i < N; i += 8)
+        {
+            uint64_t value = rng();
+            for(size_t j = 0; j < 8 && i + j < N; ++j)
+            {
+                id[i + j] = static_cast<uint8_t>(value >> (j * 8));
+            }
+        }
+    } while(std::all_of(id.begin(), id.end(), [](uint8_t b) { return b == 0; }));  // 全 0 是非法的 id
+}
+
+template <size_t N>
+std::string toHex(const std::array<uint8_t, N>& id)
+{
+    static const char kDigits[] = "0123456789abcdef";
+    std::string result(N * 2, '0');
+    for(size_t i = 0; i < N; ++i)
+    {
+        result[i * 2] = kDigits[id[i] >> 4];
+        result[i * 2 + 1] = kDigits[id[i] & 0x0F];
+    }
+    return result;
+}
+
+// W3C 规定只能是小写的十六进制
+int hexValue(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+template <size_t N>
+bool parseHex(const std::string& text, size_t pos, std::array<uint8_t, N>& id)
+{
+    bool nonZero = false;
+    for(size_t i = 0; i < N; ++i)
+    {
+        int high = hexValue(text[pos + i * 2]);
+        int low = hexValue(text[pos + i * 2 + 1]);
+        if(high < 0 || low < 0)
+        {
+            return false;
+        }
+        id[i] = static_cast<uint8_t>(high << 4 | low);
+        nonZero = nonZero || id[i] != 0;
+    }
+    return nonZero;
+}
+
+json stringAttribute(const char* key, const std::string& value)
+{
+    return json{{"key", key}, {"value", {{"stringValue", value}}}};
+}
+
+} // namespace
+
+RequestTrace::RequestTrace(int64_t receiveMicros)
+    : receiveWall(receiveMicros)
+    , wallAtCreate(muduo::Timestamp::now().microSecondsSinceEpoch())
+    , monoAtCreate(metrics::nowMicros())
+{
+    // 从读到数据到解析完成，在这之前还没有 trace，只能用 muduo 记录的接收时间倒推
+    phases.reserve(16);
+    int64_t parseMicros = std::max<int64_t>(0, wallAtCreate - receiveWall);
+    phases.push_back(Phase{"parse", nullptr, monoAtCreate - std::min<uint64_t>(parseMicros, monoAtCreate), monoAtCreate});
+}
+
+bool RequestTrace::parseTraceparent(const std::string& header, bool& parentSampled)
+{
+    // 版本 00 的长度固定是 55，以后的版本可以在后面加字段，但是前 55 个字符的格式不变
+    if(header.size() < 55 || header[2] != '-' || header[35] != '-' || header[52] != '-')
+    {
+        return false;
+    }
+    if(header.compare(0, 2, "ff") == 0 || hexValue(header[0]) < 0 || hexValue(header[1]) < 0
+       || (header.compare(0, 2, "00") == 0 ? header.size() != 55 : (header.size() > 55 && header[55] != '-')))
+    {
+        return false;
+    }
+
+    TraceId trace;
+    SpanId parent;
+    if(!parseHex(header, 3, trace) || !parseHex(header, 36, parent))
+    {
+        return false;
+    }
+    if(hexValue(header[53]) < 0 || hexValue(header[54]) < 0)
+    {
+        return false;
+    }
+    int flags = hexValue(header[53]) << 4 | hexValue(header[54]);
+
+    traceId = trace;
+    parentSpanId = parent;
+    hasParent = true;
+    randomId(spanId);
+    parentSampled = (flags & 0x01) != 0;
+    return true;
+}
+
+void RequestTrace::startNewTrace()
+{
+    randomId(traceId);
+    randomId(spanId);
+    hasParent = false;
+}
+
+std::string RequestTrace::traceparent() const
+{
+    return "00-" + toHex(traceId) + "-" + toHex(spanId) + (sampled ? "-01" : "-00");
+}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+void Tracer::start(const TraceConfig& config)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(running_)
+    {
+        LOG_WARN << "Tracer already started, exporting to " << config_.exportPath;
+        return;
+    }
+    config_ = config;
+    sampleRatio_ = config.sampleRatio;
+    running_ = true;
+    thread_ = std::thread(&Tracer::exportLoop, this);
+    enabled_.store(true, std::memory_order_relaxed);
+    LOG_INFO << "Tracer started, exporting to " << config_.exportPath;
+}
+
+void Tracer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!running_)
+        {
+            return;
+        }
+        running_ = false;
+        enabled_.store(false, std::memory_order_relaxed);
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void Tracer::submit(std::shared_ptr<RequestTrace> trace)
+{
+    if(!trace || !trace->sampled)
+    {
+        return;
+    }
+
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!running_ || queue_.size() >= config_.maxQueueSize)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue_.push_back(std::move(trace));
+        notify = queue_.size() >= config_.batchSize;
+    }
+    if(notify)
+    {
+        cond_.notify_one();
+    }
+}
+
+void Tracer::exportLoop()
+{
+    FILE* file = ::fopen(config_.exportPath.c_str(), "a");
+    if(!file)
+    {
+        LOG_ERROR << "Tracer: cannot open " << config_.exportPath << ", traces will be dropped";
+    }
+
+    std::vector<std::shared_ptr<RequestTrace>> batch;
+    bool running = true;
+    while(running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(config_.flushIntervalMs), [this] {
+                return !running_ || queue_.size() >= config_.batchSize;
+            });
+            batch.swap(queue_);
+            running = running_;
+        }
+
+        // 序列化和写文件都在锁外面做，IO 线程提交的时候不会等
+        if(!batch.empty() && file)
+        {
+            std::string line = renderBatch(batch);
+            line += '\n';
+            ::fwrite(line.data(), 1, line.size(), file);
+            ::fflush(file);
+        }
+        batch.clear();
+    }
+
+    if(file)
+    {
+        ::fclose(file);
+    }
+}
+
+std::string Tracer::renderBatch(const std::vector<std::shared_ptr<RequestTrace>>& batch) const
+{
+    json spans = json::array();
+    for(const auto& trace : batch)
+    {
+        std::string traceId = toHex(trace->traceId);
+        std::string spanId = toHex(trace->spanId);
+
+        // 整个请求是一个 SERVER span，每个阶段是它下面的一个 INTERNAL span
+        json root;
+        root["traceId"] = traceId;
+        root["spanId"] = spanId;
+        if(trace->hasParent)
+        {
+            root["parentSpanId"] = toHex(trace->parentSpanId);
+        }
+        root["name"] = trace->route.empty() ? trace->method : trace->method + " " + trace->route;
+        root["kind"] = 2;
+        // OTLP 的 JSON 编码里面 64 位整数用字符串表示
+        root["startTimeUnixNano"] = std::to_string(static_cast<uint64_t>(trace->receiveWall) * 1000);
+        root["endTimeUnixNano"] = std::to_string(trace->toUnixNanos(trace->monoEnd));
+        json attributes = json::array();
+        attributes.push_back(stringAttribute("http.request.method", trace->method));
+        attributes.push_back(stringAttribute("url.path", trace->path));
+        if(!trace->route.empty())
+        {
+            attributes.push_back(stringAttribute("http.route", trace->route));
+        }
+        if(!trace->peerIp.empty())
+        {
+            attributes.push_back(stringAttribute("client.address", trace->peerIp));
+        }
+        attributes.push_back(json{{"key", "http.response.status_code"},
+                                  {"value", {{"intValue", std::to_string(trace->statusCode)}}}});
+        root["attributes"] = std::move(attributes);
+        root["status"] = trace->statusCode >= 500 ? json{{"code", 2}} : json::object();
+        spans.push_back(std::move(root));
+
+        for(const auto& phase : trace->phases)
+        {
+            RequestTrace::SpanId phaseId;
+            randomId(phaseId);
+            json span;
+            span["traceId"] = traceId;
+            span["spanId"] = toHex(phaseId);
+            span["parentSpanId"] = spanId;
+            span["name"] = phase.detail ? std::string(phase.name) + " " + phase.detail : std::string(phase.name);
+            span["kind"] = 1;
+            span["startTimeUnixNano"] = std::to_string(trace->toUnixNanos(phase.start));
+            span["endTimeUnixNano"] = std::to_string(trace->toUnixNanos(phase.end));
+            spans.push_back(std::move(span));
+        }
+    }
+
+    json request;
+    request["resourceSpans"] = json::array({
+        {
+            {"resource", {{"attributes", json::array({stringAttribute("service.name", config_.serviceName)})}}},
+            {"scopeSpans", json::array({{{"scope", {{"name", "http.trace"}}}, {"spans", std::move(spans)}}})}
+        }
+    });
+    return request.dump();
+}
+
+} // namespace trace
+} // namespace http
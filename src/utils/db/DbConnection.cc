@@ -58,6 +58,25 @@ DbConnection::~DbConnection()
     LOG_INFO << "Database connection closed";
 }
 
+int DbConnection::executeBatchUpdate(const std::string& sql, const std::vector<std::string>& params)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    try
+    {
+        std::unique_ptr<sql::PreparedStatement> stmt(conn_->prepareStatement(sql));
+        for(size_t i = 0; i < params.size(); ++i)
+        {
+            stmt->setString(static_cast<int>(i + 1), params[i]);
+        }
+        return stmt->executeUpdate();
+    }
+    catch(const sql::SQLException& e)
+    {
+        LOG_ERROR << "Batch update failed: " << e.what() << ", params: " << params.size();
+        throw DbException(e.what());
+    }
+}
+
 bool DbConnection::ping()
 {
     try